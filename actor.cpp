@@ -6,7 +6,6 @@
 //  accompanying file LICENSE_1_0.txt or copy at
 //  http://www.boost.org/LICENSE_1_0.txt)
 
-#include <cassert>
 #include <iostream>
 
 #include "atomiclock.hpp"
@@ -15,37 +14,58 @@
 
 namespace znl {
 
-void Actor::_run()
+namespace {
+
+// An output iterator for pop_bulk() that runs each task stored through it.
+struct Runner
 {
-  assert( _count );
-  for( ;; ) {
+  Runner& operator*() { return *this; }
+  Runner& operator++() { return *this; }
+  Runner& operator++( int ) { return *this; }
 #ifdef ZNL_ACTOR_INTRUSIVE
-    Task *task = _actionqueue.pop();
-    if(  task ) {
-      ( *task )();
-      delete task;
+  Runner& operator=( const Task* task_ ) {
+    ( *task_ )();
+    pool->deallocate( const_cast<Task*>( task_ ) );
+    return *this;
+  }
+  TaskPool* pool;
 #else
-    Func func;
-    if( _actionqueue.pop( func ) ) {
-      func();
+  Runner& operator=( Func&& func_ ) {
+    func_();
+    return *this;
+  }
 #endif
-      if( 0 == --_count ) {
-        AtomicLockGuard guard( _lock );
-        if( 0 == _count ) {
-          _running = false;
-          break;
-        }
+};
+
+} //namespace
+
+void Actor::_run()
+{
+  for( ;; ) {
+    // no more than the sends counted so far, so that _count stays >= 0
+    const int counted = _count;
+    if( !counted ) {
+      AtomicLockGuard guard( _lock );
+      if( 0 == _count ) {
+        _running = false;
+        break;
       }
+      continue;
     }
+#ifdef ZNL_ACTOR_INTRUSIVE
+    _count -= static_cast<int>( _actionqueue.pop_bulk( Runner{ &_taskpool }, counted ) );
+#else
+    _count -= static_cast<int>( _actionqueue.pop_bulk( Runner{}, counted ) );
+#endif
   }
 }
 
-void Actor::send( std::function<void()>&& func_ )
+void Actor::send( Func&& func_ )
 {
 #ifdef ZNL_ACTOR_INTRUSIVE
-  _actionqueue.push( *new Task( std::move( func_ ) ) );
+  _actionqueue.push( *_taskpool.allocate( std::move( func_ ) ) );
 #else
-  _actionqueue.push( func_ );
+  _actionqueue.push( std::move( func_ ) );
 #endif
   if( 0 == _count++ ) {
     AtomicLockGuard guard( _lock );
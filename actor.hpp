@@ -14,6 +14,12 @@
 #include <string>
 
 #include "taskqueue.hpp"
+#ifdef ZNL_ACTOR_BOUNDED
+#include "boundedmpscqueue.hpp"
+#endif
+#ifdef ZNL_ACTOR_SHARDS
+#include "shardedqueue.hpp"
+#endif
 
 #ifdef BOOST_HAS_PRAGMA_ONCE
 #pragma once
@@ -24,14 +30,23 @@
 #endif
 
 
-//#define ZNL_ACTOR_INTRUSIVE
+//#define ZNL_ACTOR_FUNCQUEUE // allocating FuncQueue mailbox
+//#define ZNL_ACTOR_BOUNDED 1024 // mailbox capacity
+//#define ZNL_ACTOR_SHARDS 16 // intrusive mailbox sharded by sending thread
+#if !defined(ZNL_ACTOR_FUNCQUEUE) && !defined(ZNL_ACTOR_BOUNDED)
+#define ZNL_ACTOR_INTRUSIVE
+#endif
 
 namespace znl {
 namespace detail {
 } //namespace detail
 
-#ifdef ZNL_ACTOR_INTRUSIVE
+#if defined(ZNL_ACTOR_INTRUSIVE) && defined(ZNL_ACTOR_SHARDS)
+  using ActionQueue = ShardedMPSCIntrQueue<Task, ZNL_ACTOR_SHARDS>;
+#elif defined(ZNL_ACTOR_INTRUSIVE)
   using ActionQueue = TaskQueue;
+#elif defined(ZNL_ACTOR_BOUNDED)
+  using ActionQueue = BoundedMPSCQueue<Func, ZNL_ACTOR_BOUNDED>;
 #else
   using ActionQueue = FuncQueue;
 #endif
@@ -52,6 +67,9 @@ private:
   void _run();
 private:
   std::string         _name;
+#ifdef ZNL_ACTOR_INTRUSIVE
+  TaskPool            _taskpool;
+#endif
   ActionQueue         _actionqueue;
   bool                _running;
   std::atomic_flag    _lock;
@@ -0,0 +1,179 @@
+//  Lock-free bounded MPSC queue based on
+//  Vyukov, Dmitry,
+//  http://www.1024cores.net/home/lock-free-algorithms/queues/bounded-mpmc-queue
+//
+//  Copyright (C) 2018 Zoltan N. Leskowsky
+//
+//  Distributed under the Boost Software License, Version 1.0. (See
+//  accompanying file LICENSE_1_0.txt or copy at
+//  http://www.boost.org/LICENSE_1_0.txt)
+
+#ifndef ZNL_BOUNDED_MPSC_QUEUE_HPP_INCLUDED
+#define ZNL_BOUNDED_MPSC_QUEUE_HPP_INCLUDED
+
+#include <atomic>
+#include <cstddef>
+#include <limits>
+#include <thread>
+#include <utility>
+#include "mpscqueue.hpp"
+
+#ifdef BOOST_HAS_PRAGMA_ONCE
+#pragma once
+#endif
+
+
+#if defined(_MSC_VER)
+#endif
+
+
+namespace znl {
+
+// Ring of N slots, each with a sequence number: a slot is free for the
+// producer claiming position pos when its sequence is pos, and full for the
+// consumer at position pos when its sequence is pos + 1. Producers claim
+// positions with a CAS on _tail; the single consumer owns _head.
+//
+// push()/pop() match MPSCQueue so the two can be swapped; push() waits for
+// space when the ring is full. Padding places _tail, _head and the ring, as
+// for MPSCQueueBase.
+
+template<typename T, std::size_t N, typename Padding = CacheLinePadding<>>
+class BoundedMPSCQueue
+{
+  static_assert( N >= 2 && ( N & ( N - 1 ) ) == 0, "N must be a power of 2" );
+  struct Slot {
+    std::atomic<std::size_t> _seq;
+    T                        _value;
+  };
+public:
+  static constexpr std::size_t capacity = N;
+
+  BoundedMPSCQueue() : _tail( 0 ), _head( 0 ) {
+    for( std::size_t i = 0; i < N; ++i ) {
+      _slots[i]._seq.store( i, std::memory_order_relaxed );
+    }
+  }
+  BoundedMPSCQueue( const BoundedMPSCQueue& ) = delete;
+  BoundedMPSCQueue& operator=( const BoundedMPSCQueue& ) = delete;
+
+  bool try_push( const T& value_ ) {
+    Slot* slot = claim();
+    if( !slot ) {
+      return false;
+    }
+    slot->_value = value_;
+    publish( *slot );
+    return true;
+  }
+  bool try_push( T&& value_ ) {
+    Slot* slot = claim();
+    if( !slot ) {
+      return false;
+    }
+    slot->_value = std::move( value_ );
+    publish( *slot );
+    return true;
+  }
+  void push( const T& value_ ) {
+    Slot* slot;
+    while( ( slot = claim() ) == nullptr ) {
+      std::this_thread::yield(); // full
+    }
+    slot->_value = value_;
+    publish( *slot );
+  }
+  void push( T&& value_ ) {
+    Slot* slot;
+    while( ( slot = claim() ) == nullptr ) {
+      std::this_thread::yield(); // full
+    }
+    slot->_value = std::move( value_ );
+    publish( *slot );
+  }
+  bool try_pop( T& value_ ) {
+    Slot& slot = _slots[_head & ( N - 1 )];
+    if( slot._seq.load( std::memory_order_acquire ) != _head + 1 ) {
+      return false;
+    }
+    value_ = std::move( slot._value );
+    slot._seq.store( _head + N, std::memory_order_release );
+    ++_head;
+    return true;
+  }
+  bool pop( T& value_ ) { return try_pop( value_ ); }
+  // As pop(), but waits out a producer that has claimed the slot and not
+  // yet published it rather than reporting empty, calling Backoff() between
+  // attempts.
+  template<typename Backoff = detail::SpinYieldBackoff<>>
+  bool waiting_pop( T& value_ ) {
+    Backoff backoff;
+    while( !try_pop( value_ ) ) {
+      if( is_empty() ) {
+        return false;
+      }
+      backoff();
+    }
+    return true;
+  }
+  // From the consumer: no slot claimed past _head.
+  bool is_empty() const { return _tail.load( std::memory_order_acquire ) == _head; }
+  template<typename OutputIt>
+  std::size_t pop_bulk( OutputIt out_, std::size_t max_ ) {
+    return consume( [&out_] ( T& value_ ) { *out_++ = std::move( value_ ); }, max_ );
+  }
+  template<typename F>
+  std::size_t consume_all( F f_ ) {
+    return consume( f_, std::numeric_limits<std::size_t>::max() );
+  }
+
+private:
+  template<typename F>
+  std::size_t consume( F&& f_, std::size_t max_ ) {
+    std::size_t n = 0;
+    while( n < max_ ) {
+      Slot& slot = _slots[_head & ( N - 1 )];
+      if( slot._seq.load( std::memory_order_acquire ) != _head + 1 ) {
+        break;
+      }
+      f_( slot._value );
+      slot._seq.store( _head + N, std::memory_order_release );
+      ++_head;
+      ++n;
+    }
+    return n;
+  }
+  Slot* claim() {
+    std::size_t pos = _tail.load( std::memory_order_relaxed );
+    for( ;; ) {
+      Slot& slot = _slots[pos & ( N - 1 )];
+      std::size_t seq = slot._seq.load( std::memory_order_acquire );
+      std::ptrdiff_t diff = static_cast<std::ptrdiff_t>( seq - pos );
+      if( diff == 0 ) {
+        if( _tail.compare_exchange_weak( pos, pos + 1, std::memory_order_relaxed ) ) {
+          return &slot;
+        }
+      } else if( diff < 0 ) {
+        return nullptr; // full
+      } else {
+        pos = _tail.load( std::memory_order_relaxed );
+      }
+    }
+  }
+  void publish( Slot& slot_ ) {
+    std::size_t pos = slot_._seq.load( std::memory_order_relaxed );
+    slot_._seq.store( pos + 1, std::memory_order_release );
+  }
+
+private:
+  alignas( Padding::alignment ) std::atomic<std::size_t> _tail;
+  alignas( Padding::alignment ) std::size_t              _head; // consumer-owned
+  alignas( Padding::alignment ) Slot                     _slots[N];
+};
+
+template<typename T, std::size_t N, typename Padding>
+constexpr std::size_t BoundedMPSCQueue<T, N, Padding>::capacity;
+
+} //namespace znl
+
+#endif //ZNL_BOUNDED_MPSC_QUEUE_HPP_INCLUDED
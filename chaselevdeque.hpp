@@ -0,0 +1,154 @@
+//  Lock-free work-stealing deque based on
+//  Chase, David and Lev, Yossi, "Dynamic Circular Work-Stealing Deque", 2005,
+//  with the C11 orderings of
+//  Le, Nhat Minh et al., "Correct and Efficient Work-Stealing for Weak Memory
+//  Models", 2013
+//
+//  Copyright (C) 2018 Zoltan N. Leskowsky
+//
+//  Distributed under the Boost Software License, Version 1.0. (See
+//  accompanying file LICENSE_1_0.txt or copy at
+//  http://www.boost.org/LICENSE_1_0.txt)
+
+#ifndef ZNL_CHASE_LEV_DEQUE_HPP_INCLUDED
+#define ZNL_CHASE_LEV_DEQUE_HPP_INCLUDED
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <type_traits>
+
+#include "mpscqueue.hpp"
+
+#ifdef BOOST_HAS_PRAGMA_ONCE
+#pragma once
+#endif
+
+
+#if defined(_MSC_VER)
+#endif
+
+
+namespace znl {
+
+// The owner pushes and pops at the bottom, LIFO; any other thread steals
+// from the top, FIFO. Only the last value is contended, between pop() and
+// steal(), and settled by a CAS on _top. steal() also fails when it loses to
+// another thief, so thieves move on to another victim rather than retry.
+//
+// The ring doubles when full. Thieves may still be reading a replaced ring,
+// so replaced rings are kept until the deque is destroyed; together they are
+// smaller than the last one.
+//
+// T must be trivially copyable, e.g. a pointer.
+
+template<typename T, typename Padding = MPSCDefaultPadding>
+class ChaseLevDeque
+{
+  static_assert( std::is_trivially_copyable<T>::value, "T must be trivially copyable" );
+  struct Ring {
+    explicit Ring( std::size_t capacity_ )
+      : _mask( capacity_ - 1 ), _slots( new std::atomic<T>[capacity_] ), _prev( nullptr ) {}
+    ~Ring() { delete[] _slots; }
+    std::size_t capacity() const { return _mask + 1; }
+    T get( std::int64_t i_ ) const { return _slots[i_ & _mask].load( std::memory_order_relaxed ); }
+    void put( std::int64_t i_, const T& value_ ) {
+      _slots[i_ & _mask].store( value_, std::memory_order_relaxed );
+    }
+    const std::size_t _mask;
+    std::atomic<T>*   _slots;
+    Ring*             _prev; // replaced rings
+  };
+public:
+  explicit ChaseLevDeque( std::size_t capacity_ = 64 )
+    : _top( 0 ), _bottom( 0 ), _ring( new Ring( round_up( capacity_ ) ) ) {}
+  ChaseLevDeque( const ChaseLevDeque& ) = delete;
+  ChaseLevDeque& operator=( const ChaseLevDeque& ) = delete;
+  ~ChaseLevDeque() {
+    Ring* prev;
+    for( Ring* ring = _ring.load( std::memory_order_relaxed ); ring; ring = prev ) {
+      prev = ring->_prev;
+      delete ring;
+    }
+  }
+
+  // owner
+  void push( const T& value_ ) {
+    const std::int64_t b = _bottom.load( std::memory_order_relaxed );
+    const std::int64_t t = _top.load( std::memory_order_acquire );
+    Ring* ring = _ring.load( std::memory_order_relaxed );
+    if( b - t >= static_cast<std::int64_t>( ring->capacity() ) ) {
+      ring = grow( ring, t, b );
+    }
+    ring->put( b, value_ );
+    _bottom.store( b + 1, std::memory_order_release );
+  }
+  bool pop( T& value_ ) {
+    const std::int64_t b = _bottom.load( std::memory_order_relaxed ) - 1;
+    Ring* ring = _ring.load( std::memory_order_relaxed );
+    _bottom.store( b, std::memory_order_relaxed );
+    std::atomic_thread_fence( std::memory_order_seq_cst );
+    std::int64_t t = _top.load( std::memory_order_relaxed );
+    if( t > b ) {
+      _bottom.store( b + 1, std::memory_order_relaxed ); // was empty
+      return false;
+    }
+    value_ = ring->get( b );
+    if( t == b ) { // last one: race the thieves for it
+      const bool won = _top.compare_exchange_strong( t, t + 1, std::memory_order_seq_cst,
+                                                     std::memory_order_relaxed );
+      _bottom.store( b + 1, std::memory_order_relaxed );
+      return won;
+    }
+    return true;
+  }
+
+  // any thread
+  bool steal( T& value_ ) {
+    std::int64_t t = _top.load( std::memory_order_acquire );
+    std::atomic_thread_fence( std::memory_order_seq_cst );
+    const std::int64_t b = _bottom.load( std::memory_order_acquire );
+    if( t >= b ) {
+      return false;
+    }
+    const Ring* ring = _ring.load( std::memory_order_acquire );
+    const T value = ring->get( t );
+    if( !_top.compare_exchange_strong( t, t + 1, std::memory_order_seq_cst,
+                                       std::memory_order_relaxed ) ) {
+      return false; // lost to pop() or another thief
+    }
+    value_ = value;
+    return true;
+  }
+  // May be stale by the time it returns, unless called by the owner.
+  bool is_empty() const {
+    return _top.load( std::memory_order_acquire ) >= _bottom.load( std::memory_order_acquire );
+  }
+
+private:
+  static std::size_t round_up( std::size_t capacity_ ) {
+    std::size_t capacity = 2;
+    while( capacity < capacity_ ) {
+      capacity <<= 1;
+    }
+    return capacity;
+  }
+  Ring* grow( Ring* ring_, std::int64_t top_, std::int64_t bottom_ ) {
+    Ring* ring = new Ring( 2 * ring_->capacity() );
+    for( std::int64_t i = top_; i < bottom_; ++i ) {
+      ring->put( i, ring_->get( i ) );
+    }
+    ring->_prev = ring_;
+    _ring.store( ring, std::memory_order_release );
+    return ring;
+  }
+
+private:
+  alignas( Padding::alignment ) std::atomic<std::int64_t> _top;     // thieves
+  alignas( Padding::alignment ) std::atomic<std::int64_t> _bottom;  // owner
+  std::atomic<Ring*>                                      _ring;
+};
+
+} //namespace znl
+
+#endif //ZNL_CHASE_LEV_DEQUE_HPP_INCLUDED
@@ -0,0 +1,161 @@
+//  Eventcount over a Linux futex
+//
+//  Copyright (C) 2018 Zoltan N. Leskowsky
+//
+//  Distributed under the Boost Software License, Version 1.0. (See
+//  accompanying file LICENSE_1_0.txt or copy at
+//  http://www.boost.org/LICENSE_1_0.txt)
+
+#ifndef ZNL_EVENTCOUNT_HPP_INCLUDED
+#define ZNL_EVENTCOUNT_HPP_INCLUDED
+
+#include <atomic>
+#include <chrono>
+#include <climits>
+#include <cstdint>
+
+#if defined(__linux__)
+#include <time.h>
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#else
+#include <condition_variable>
+#include <mutex>
+#endif
+
+#ifdef BOOST_HAS_PRAGMA_ONCE
+#pragma once
+#endif
+
+
+#if defined(_MSC_VER)
+#endif
+
+
+namespace znl {
+
+// Lets a consumer sleep until a condition it polls, such as a non-empty
+// queue, may have changed, without a lock on either side:
+//
+//   for( ;; ) {
+//     if( try_pop() ) break;
+//     const EventCount::Key key = ec.prepare_wait();
+//     if( try_pop() ) { ec.cancel_wait(); break; }
+//     ec.commit_wait( key );
+//   }
+//
+// and producers call notify() after making the condition true. A waiter is
+// counted before its last check, and notify() looks for waiters after the
+// change; seq_cst fences on both sides order these, so either the waiter sees
+// the change or notify() sees the waiter. notify() bumps the epoch, so a
+// commit_wait() with an older key returns at once.
+//
+// Without waiters notify() is a fence and a load; otherwise it and
+// commit_wait() each cost one futex call. Nothing allocates.
+
+class EventCount
+{
+public:
+  typedef std::uint32_t Key;
+
+  EventCount() : _epoch( 0 ), _waiters( 0 ) {}
+  EventCount( const EventCount& ) = delete;
+  EventCount& operator=( const EventCount& ) = delete;
+
+  Key prepare_wait() {
+    _waiters.fetch_add( 1, std::memory_order_relaxed );
+    std::atomic_thread_fence( std::memory_order_seq_cst );
+    return _epoch.load( std::memory_order_acquire );
+  }
+  void cancel_wait() { _waiters.fetch_sub( 1, std::memory_order_relaxed ); }
+  void commit_wait( Key key_ ) {
+    while( _epoch.load( std::memory_order_acquire ) == key_ ) {
+      park( key_ );
+    }
+    _waiters.fetch_sub( 1, std::memory_order_relaxed );
+  }
+  // As commit_wait(), for at most timeout_; false if it timed out.
+  bool commit_wait_for( Key key_, std::chrono::nanoseconds timeout_ ) {
+    const std::chrono::steady_clock::time_point until = std::chrono::steady_clock::now() + timeout_;
+    bool notified = true;
+    while( _epoch.load( std::memory_order_acquire ) == key_ ) {
+      const std::chrono::nanoseconds left = until - std::chrono::steady_clock::now();
+      if( left.count() <= 0 ) {
+        notified = false;
+        break;
+      }
+      park_for( key_, left );
+    }
+    _waiters.fetch_sub( 1, std::memory_order_relaxed );
+    return notified;
+  }
+  // Wakes up to n_ waiters; false if there were none.
+  bool notify( int n_ = 1 ) {
+    std::atomic_thread_fence( std::memory_order_seq_cst );
+    if( _waiters.load( std::memory_order_relaxed ) ) {
+      wake( n_ );
+      return true;
+    }
+    return false;
+  }
+  bool notify_all() { return notify( INT_MAX ); }
+  // For a notifier that fences once and then looks at several EventCounts.
+  bool has_waiters() const { return _waiters.load( std::memory_order_relaxed ) != 0; }
+
+private:
+#if defined(__linux__)
+  void park( Key key_ ) {
+    ::syscall( SYS_futex, reinterpret_cast<std::uint32_t*>( &_epoch ), FUTEX_WAIT_PRIVATE,
+               key_, nullptr, nullptr, 0 );
+  }
+  void park_for( Key key_, std::chrono::nanoseconds timeout_ ) {
+    struct timespec ts;
+    ts.tv_sec = static_cast<time_t>( timeout_.count() / 1000000000 );
+    ts.tv_nsec = static_cast<long>( timeout_.count() % 1000000000 );
+    ::syscall( SYS_futex, reinterpret_cast<std::uint32_t*>( &_epoch ), FUTEX_WAIT_PRIVATE,
+               key_, &ts, nullptr, 0 );
+  }
+  void wake( int n_ ) {
+    _epoch.fetch_add( 1, std::memory_order_release );
+    ::syscall( SYS_futex, reinterpret_cast<std::uint32_t*>( &_epoch ), FUTEX_WAKE_PRIVATE,
+               n_, nullptr, nullptr, 0 );
+  }
+#else
+  void park( Key key_ ) {
+    std::unique_lock<std::mutex> lk( _mutex );
+    _condvar.wait( lk, [this, key_] () {
+                         return _epoch.load( std::memory_order_acquire ) != key_;
+                       } );
+  }
+  void park_for( Key key_, std::chrono::nanoseconds timeout_ ) {
+    std::unique_lock<std::mutex> lk( _mutex );
+    _condvar.wait_for( lk, timeout_, [this, key_] () {
+                         return _epoch.load( std::memory_order_acquire ) != key_;
+                       } );
+  }
+  void wake( int n_ ) {
+    {
+      std::lock_guard<std::mutex> lk( _mutex );
+      _epoch.fetch_add( 1, std::memory_order_release );
+    }
+    if( n_ == 1 ) {
+      _condvar.notify_one();
+    } else {
+      _condvar.notify_all();
+    }
+  }
+#endif
+
+private:
+  std::atomic<std::uint32_t> _epoch; // futex word
+  std::atomic<std::uint32_t> _waiters;
+#if !defined(__linux__)
+  std::mutex                 _mutex;
+  std::condition_variable    _condvar;
+#endif
+};
+
+} //namespace znl
+
+#endif //ZNL_EVENTCOUNT_HPP_INCLUDED
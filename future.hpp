@@ -0,0 +1,266 @@
+//  Future for Worker::submit(), kept in the submitted Task
+//
+//  Copyright (C) 2018 Zoltan N. Leskowsky
+//
+//  Distributed under the Boost Software License, Version 1.0. (See
+//  accompanying file LICENSE_1_0.txt or copy at
+//  http://www.boost.org/LICENSE_1_0.txt)
+
+#ifndef ZNL_FUTURE_HPP_INCLUDED
+#define ZNL_FUTURE_HPP_INCLUDED
+
+#include <atomic>
+#include <climits>
+#include <cstdint>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+#if defined(__linux__)
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#else
+#include <thread>
+#endif
+
+#include "taskqueue.hpp"
+
+#ifdef BOOST_HAS_PRAGMA_ONCE
+#pragma once
+#endif
+
+
+#if defined(_MSC_VER)
+#endif
+
+
+namespace znl {
+
+class Worker;
+template<typename R> class Future;
+
+namespace detail {
+
+// The shared state of a submit(): the callable, a state word and the result
+// slot live together in the Func of the submitted Task, so a submit()
+// allocates no more than a send( Func&& ), and nothing when they fit in
+// ZNL_INPLACE_TASK_SIZE. The Task stays allocated until both the Worker has
+// run it and the Future has let go; whichever comes second returns it.
+
+class FutureStateBase
+{
+public:
+  enum : std::uint32_t {
+    ready     = 1,
+    detached  = 2, // the Future let go, or then() took it over
+    waiting   = 4, // a thread may sleep in wait()
+    continued = 8  // then() left a continuation in _then
+  };
+
+  FutureStateBase() : _state( 0 ), _node( nullptr ), _then( nullptr ), _pool( nullptr ) {}
+  FutureStateBase( FutureStateBase&& ) noexcept : FutureStateBase() {} // before submit() only
+#ifdef ZNL_STD_FUNCTION_TASK
+  FutureStateBase( const FutureStateBase& ) : FutureStateBase() {} // std::function copies targets
+#endif
+
+  bool is_ready() const { return _state.load( std::memory_order_acquire ) & ready; }
+  void wait() {
+    std::uint32_t state = _state.load( std::memory_order_acquire );
+    while( !( state & ready ) ) {
+      if( !( state & waiting ) &&
+          !_state.compare_exchange_weak( state, state | waiting, std::memory_order_acquire ) ) {
+        continue;
+      }
+      park( state | waiting );
+      state = _state.load( std::memory_order_acquire );
+    }
+  }
+  // Lets go of the Task from the Future's side.
+  void release() {
+    if( _state.fetch_or( detached, std::memory_order_acq_rel ) & ready ) {
+      _pool->deallocate_shared( _node );
+    }
+  }
+
+protected:
+  template<typename> friend class znl::Future;
+  friend class znl::Worker;
+
+  // On the Worker, once the result is stored, as the last use of the Task:
+  // unless the Future has let go, it may free the Task as soon as it sees
+  // ready.
+  void complete() {
+    const std::uint32_t prev = _state.fetch_or( ready, std::memory_order_acq_rel );
+    if( prev & waiting ) {
+      wake(); // this may be freed by now; a stray wake is harmless
+    }
+    if( prev & continued ) {
+      run_then();
+    }
+    if( prev & detached ) {
+      _pool->deallocate_shared( _node ); // like delete this
+    }
+  }
+  void run_then() {
+    ( *_then )();
+    _pool->deallocate_shared( _then );
+  }
+#if defined(__linux__)
+  void park( std::uint32_t state_ ) {
+    ::syscall( SYS_futex, reinterpret_cast<std::uint32_t*>( &_state ), FUTEX_WAIT_PRIVATE,
+               state_, nullptr, nullptr, 0 );
+  }
+  void wake() {
+    ::syscall( SYS_futex, reinterpret_cast<std::uint32_t*>( &_state ), FUTEX_WAKE_PRIVATE,
+               INT_MAX, nullptr, nullptr, 0 );
+  }
+#else
+  void park( std::uint32_t state_ ) {
+    while( _state.load( std::memory_order_acquire ) == state_ ) {
+      std::this_thread::yield();
+    }
+  }
+  void wake() {}
+#endif
+
+protected:
+  std::atomic<std::uint32_t> _state; // futex word
+  Task*                      _node;
+  Task*                      _then;
+  TaskPool*                  _pool;
+};
+
+template<typename R>
+class FutureState : public FutureStateBase
+{
+public:
+  FutureState() = default;
+  FutureState( FutureState&& ) noexcept {}
+#ifdef ZNL_STD_FUNCTION_TASK
+  FutureState( const FutureState& ) : FutureStateBase() {}
+#endif
+  ~FutureState() {
+    if( _state.load( std::memory_order_relaxed ) & ready ) {
+      value().~R();
+    }
+  }
+  R take() { return std::move( value() ); }
+  template<typename G>
+  void pass_to( G& g_ ) { g_( take() ); }
+
+protected:
+  template<typename F>
+  void set( F& f_ ) { ::new ( &_result ) R( f_() ); }
+  R& value() { return *reinterpret_cast<R*>( &_result ); }
+
+private:
+  typename std::aligned_storage<sizeof( R ), alignof( R )>::type _result;
+};
+
+template<>
+class FutureState<void> : public FutureStateBase
+{
+public:
+  void take() {}
+  template<typename G>
+  void pass_to( G& g_ ) { g_(); }
+
+protected:
+  template<typename F>
+  void set( F& f_ ) { f_(); }
+};
+
+template<typename R, typename G>
+struct Continuation
+{
+  void operator()() { state->pass_to( g ); }
+  FutureState<R>* state;
+  G               g;
+};
+
+template<typename F, typename R>
+class Submitted : public FutureState<R>
+{
+public:
+  explicit Submitted( F&& f_ ) : _f( std::move( f_ ) ) {}
+  explicit Submitted( const F& f_ ) : _f( f_ ) {}
+  Submitted( Submitted&& submitted_ ) noexcept( std::is_nothrow_move_constructible<F>::value )
+    : FutureState<R>( std::move( submitted_ ) ), _f( std::move( submitted_._f ) ) {}
+#ifdef ZNL_STD_FUNCTION_TASK
+  Submitted( const Submitted& submitted_ ) : FutureState<R>( submitted_ ), _f( submitted_._f ) {}
+#endif
+  void operator()() {
+    this->set( _f );
+    this->complete();
+  }
+
+private:
+  F _f;
+};
+
+} //namespace detail
+
+// The result of Worker::submit(), like std::future but with no allocation,
+// mutex or condition variable: get() sleeps on a futex in the state word
+// only if the result is not there yet. Exceptions are not carried over, so
+// the submitted callable must not throw. A Future must not outlive its
+// Worker.
+//
+// then( g_ ) takes the Future over and calls g_( result ) on the Worker, right
+// after the callable if that has not run yet, else as a Task sent to it.
+
+template<typename R>
+class Future
+{
+public:
+  Future() : _state( nullptr ), _worker( nullptr ) {}
+  Future( Future&& future_ ) : _state( future_._state ), _worker( future_._worker ) {
+    future_._state = nullptr;
+  }
+  Future& operator=( Future&& future_ ) {
+    if( this != &future_ ) {
+      reset();
+      _state = future_._state;
+      _worker = future_._worker;
+      future_._state = nullptr;
+    }
+    return *this;
+  }
+  Future( const Future& ) = delete;
+  Future& operator=( const Future& ) = delete;
+  ~Future() { reset(); }
+  bool valid() const { return _state != nullptr; }
+  bool is_ready() const { return _state->is_ready(); }
+  void wait() const { _state->wait(); }
+  // Waits for the result and moves it out; the Future is then invalid.
+  R get() {
+    wait();
+    Reset reset{ this };
+    return _state->take();
+  }
+  template<typename G>
+  void then( G&& g_ ); // in worker.hpp
+
+private:
+  friend class Worker;
+  struct Reset {
+    ~Reset() { future->reset(); }
+    Future* future;
+  };
+  Future( detail::FutureState<R>* state_, Worker* worker_ ) : _state( state_ ), _worker( worker_ ) {}
+  void reset() {
+    if( _state ) {
+      _state->release();
+      _state = nullptr;
+    }
+  }
+
+private:
+  detail::FutureState<R>* _state;
+  Worker*                 _worker;
+};
+
+} //namespace znl
+
+#endif //ZNL_FUTURE_HPP_INCLUDED
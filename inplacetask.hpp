@@ -0,0 +1,181 @@
+//  Move-only void() callable with an inline capture buffer
+//
+//  Copyright (C) 2018 Zoltan N. Leskowsky
+//
+//  Distributed under the Boost Software License, Version 1.0. (See
+//  accompanying file LICENSE_1_0.txt or copy at
+//  http://www.boost.org/LICENSE_1_0.txt)
+
+#ifndef ZNL_INPLACE_TASK_HPP_INCLUDED
+#define ZNL_INPLACE_TASK_HPP_INCLUDED
+
+#include <cassert>
+#include <cstddef>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+#ifdef BOOST_HAS_PRAGMA_ONCE
+#pragma once
+#endif
+
+
+#if defined(_MSC_VER)
+#endif
+
+// Fits a few pointers and a std::string; sizeof( InplaceTask<> ) == 64 with
+// 64-bit pointers.
+#ifndef ZNL_INPLACE_TASK_SIZE
+#define ZNL_INPLACE_TASK_SIZE 56
+#endif
+
+
+namespace znl {
+
+// Like std::function<void()>, but move-only, so captures are never copied,
+// and stored in Size inline bytes whenever they fit, are nothrow movable and
+// need no more than pointer alignment; other callables fall back to the
+// heap. Calls go through a static table per callable type.
+
+template<std::size_t Size = ZNL_INPLACE_TASK_SIZE>
+class InplaceTask
+{
+  typedef typename std::aligned_storage<Size, alignof( void* )>::type Storage;
+  struct Ops {
+    void (*invoke)( void* );
+    void (*move)( void* to_, void* from_ ); // and destroy from_
+    void (*destroy)( void* );
+  };
+  template<typename F>
+  struct InlineOps {
+    static void invoke( void* p_ ) { ( *static_cast<F*>( p_ ) )(); }
+    static void move( void* to_, void* from_ ) {
+      ::new ( to_ ) F( std::move( *static_cast<F*>( from_ ) ) );
+      static_cast<F*>( from_ )->~F();
+    }
+    static void destroy( void* p_ ) { static_cast<F*>( p_ )->~F(); }
+    static const Ops ops;
+  };
+  template<typename F>
+  struct HeapOps {
+    static void invoke( void* p_ ) { ( **static_cast<F**>( p_ ) )(); }
+    static void move( void* to_, void* from_ ) { *static_cast<F**>( to_ ) = *static_cast<F**>( from_ ); }
+    static void destroy( void* p_ ) { delete *static_cast<F**>( p_ ); }
+    static const Ops ops;
+  };
+  template<typename F>
+  struct fits : std::integral_constant<bool, sizeof( F ) <= Size &&
+                                             alignof( F ) <= alignof( Storage ) &&
+                                             std::is_nothrow_move_constructible<F>::value> {};
+  template<typename F>
+  using enable_if_callable = typename std::enable_if<
+    !std::is_same<typename std::decay<F>::type, InplaceTask>::value &&
+    std::is_void<decltype( std::declval<typename std::decay<F>::type&>()() )>::value>::type;
+
+public:
+  static constexpr std::size_t inline_size = Size;
+
+  InplaceTask() noexcept : _ops( nullptr ) {}
+  InplaceTask( std::nullptr_t ) noexcept : _ops( nullptr ) {}
+  template<typename F, typename = enable_if_callable<F>>
+  InplaceTask( F&& f_ ) : _ops( nullptr ) {
+    typedef typename std::decay<F>::type Fn;
+    if( !is_null( f_ ) ) {
+      construct<Fn>( std::forward<F>( f_ ), fits<Fn>() );
+    }
+  }
+  InplaceTask( InplaceTask&& task_ ) noexcept : _ops( task_._ops ) {
+    if( _ops ) {
+      _ops->move( &_storage, &task_._storage );
+      task_._ops = nullptr;
+    }
+  }
+  InplaceTask( const InplaceTask& ) = delete;
+  ~InplaceTask() { reset(); }
+  InplaceTask& operator=( InplaceTask&& task_ ) noexcept {
+    if( this != &task_ ) {
+      reset();
+      if( task_._ops ) {
+        task_._ops->move( &_storage, &task_._storage );
+        _ops = task_._ops;
+        task_._ops = nullptr;
+      }
+    }
+    return *this;
+  }
+  InplaceTask& operator=( const InplaceTask& ) = delete;
+  InplaceTask& operator=( std::nullptr_t ) noexcept {
+    reset();
+    return *this;
+  }
+  template<typename F, typename = enable_if_callable<F>>
+  InplaceTask& operator=( F&& f_ ) {
+    return *this = InplaceTask( std::forward<F>( f_ ) );
+  }
+  // Not on an empty task, such as the Worker's marker for one sent back.
+  void operator()() const {
+    assert( _ops );
+    _ops->invoke( const_cast<Storage*>( &_storage ) );
+  }
+  explicit operator bool() const noexcept { return _ops != nullptr; }
+  // The stored callable if it is an F, as std::function::target(); it stays
+  // put until the InplaceTask is moved from.
+  template<typename F>
+  F* target() noexcept {
+    return _ops == &InlineOps<F>::ops ? reinterpret_cast<F*>( &_storage ) :
+           _ops == &HeapOps<F>::ops ? *reinterpret_cast<F**>( &_storage ) : nullptr;
+  }
+  template<typename F>
+  const F* target() const noexcept { return const_cast<InplaceTask*>( this )->template target<F>(); }
+
+private:
+  template<typename Fn, typename F>
+  void construct( F&& f_, std::true_type ) {
+    ::new ( &_storage ) Fn( std::forward<F>( f_ ) );
+    _ops = &InlineOps<Fn>::ops;
+  }
+  template<typename Fn, typename F>
+  void construct( F&& f_, std::false_type ) {
+    *reinterpret_cast<Fn**>( &_storage ) = new Fn( std::forward<F>( f_ ) );
+    _ops = &HeapOps<Fn>::ops;
+  }
+  template<typename F>
+  static bool is_null( const F& ) { return false; }
+  template<typename F>
+  static bool is_null( F* const& f_ ) { return f_ == nullptr; }
+  void reset() noexcept {
+    if( _ops ) {
+      _ops->destroy( &_storage );
+      _ops = nullptr;
+    }
+  }
+
+private:
+  Storage     _storage;
+  const Ops*  _ops;
+};
+
+template<std::size_t Size>
+constexpr std::size_t InplaceTask<Size>::inline_size;
+
+static_assert( sizeof( InplaceTask<56> ) == 56 + sizeof( void* ), "InplaceTask should not be padded" );
+
+template<std::size_t Size>
+template<typename F>
+const typename InplaceTask<Size>::Ops InplaceTask<Size>::InlineOps<F>::ops = {
+  &InplaceTask<Size>::InlineOps<F>::invoke,
+  &InplaceTask<Size>::InlineOps<F>::move,
+  &InplaceTask<Size>::InlineOps<F>::destroy
+};
+
+template<std::size_t Size>
+template<typename F>
+const typename InplaceTask<Size>::Ops InplaceTask<Size>::HeapOps<F>::ops = {
+  &InplaceTask<Size>::HeapOps<F>::invoke,
+  &InplaceTask<Size>::HeapOps<F>::move,
+  &InplaceTask<Size>::HeapOps<F>::destroy
+};
+
+} //namespace znl
+
+#endif //ZNL_INPLACE_TASK_HPP_INCLUDED
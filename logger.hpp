@@ -39,6 +39,11 @@ typedef Worker LoggerBase;
 //template<typename LoggerBase = Actor>
 class Logger : public LoggerBase
 {
+  // Fits the Func's inline buffer, so a log() allocates nothing beyond its Task.
+  struct Print {
+    std::string _msg;
+    void operator()() const { std::cout << _msg << std::endl << std::flush; }
+  };
 public:
   Logger( const std::string& name_, bool start_ = true ) : LoggerBase( name_ ) {
     if( start_ ) {
@@ -53,7 +58,10 @@ public:
   }
   void log( const std::string& msg_ ) {
       //send( *new Task( [=] () { std::cout << msg_ << std::endl << std::flush; } ) );
-      send( Func( [=] () { std::cout << msg_ << std::endl << std::flush; } ) );
+      send( Func( Print{ msg_ } ) );
+  }
+  void log( std::string&& msg_ ) {
+      send( Func( Print{ std::move( msg_ ) } ) );
   }
   Logger& operator<<( const std::string& msg_ ) {
       log( msg_ ); return *this;
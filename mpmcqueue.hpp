@@ -0,0 +1,138 @@
+//  Lock-free MPMC intrusive and non-intrusive queues
+//
+//  Producers push as in the MPSC queues; consumers advance the shared first
+//  node with a CAS (Michael & Scott, 1996). Nodes are freed through a
+//  reclamation domain from reclaim.hpp, hazard pointers by default.
+//
+//  Copyright (C) 2018 Zoltan N. Leskowsky
+//
+//  Distributed under the Boost Software License, Version 1.0. (See
+//  accompanying file LICENSE_1_0.txt or copy at
+//  http://www.boost.org/LICENSE_1_0.txt)
+
+#ifndef ZNL_MPMC_QUEUE_HPP_INCLUDED
+#define ZNL_MPMC_QUEUE_HPP_INCLUDED
+
+#include <atomic>
+#include <cstddef>
+#include <utility>
+
+#include "atomiclock.hpp"
+#include "mpscqueue.hpp"
+#include "reclaim.hpp"
+
+#ifdef BOOST_HAS_PRAGMA_ONCE
+#pragma once
+#endif
+
+
+#if defined(_MSC_VER)
+#endif
+
+
+namespace znl {
+
+// Non-intrusive queue
+//
+// Nodes come from new/delete: MPSCNodePool recycles on a single consumer.
+// Reclaim is HazardPointers or EpochReclaim.
+
+template<typename T, typename Padding = MPSCDefaultPadding, typename Reclaim = HazardPointers>
+class MPMCQueue : public MPSCQueueBase<Padding>
+{
+  typedef MPSCQueueBase<Padding> Base;
+  enum Result { popped, empty, in_process };
+public:
+  MPMCQueue() : Base( *new MPSCNode<T>() ) {}
+  MPMCQueue( const MPMCQueue& ) = delete;
+  MPMCQueue& operator=( const MPMCQueue& ) = delete;
+  ~MPMCQueue() {
+    const MPSCNode<T>* next;
+    for( const MPSCNode<T>* node = load_first( std::memory_order_relaxed ); node; node = next ) {
+      next = node->load_next( std::memory_order_relaxed );
+      delete node;
+    }
+  }
+  void push( const T& value_ ) { Base::push( *new MPSCNode<T>( value_ ) ); }
+  void push( T&& value_ ) { Base::push( *new MPSCNode<T>( std::move( value_ ) ) ); }
+  bool pop( T& value_ ) { return try_pop( value_ ) == popped; }
+  // As pop(), but waits out a push in process rather than reporting empty.
+  template<typename Backoff = detail::SpinYieldBackoff<>>
+  bool waiting_pop( T& value_ ) {
+    Backoff backoff;
+    Result result;
+    while( ( result = try_pop( value_ ) ) == in_process ) {
+      backoff();
+    }
+    return result == popped;
+  }
+
+private:
+  Result try_pop( T& value_ ) {
+    typename Reclaim::Guard guard;
+    for( ;; ) {
+      const MPSCNode<T>* first = guard.hold( 0, load_first( std::memory_order_relaxed ) );
+      if( first != load_first( std::memory_order_seq_cst ) ) {
+        continue;
+      }
+      const MPSCNode<T>* next = guard.hold( 1, first->load_next( std::memory_order_acquire ) );
+      if( first != load_first( std::memory_order_seq_cst ) ) {
+        continue;
+      }
+      if( !next ) {
+        return first == this->load_last( std::memory_order_acquire ) ? empty : in_process;
+      }
+      const SLinkable* expected = first;
+      if( this->compare_exchange_first( expected, next ) ) {
+        // next is now the stub; only this consumer reads its value
+        value_ = std::move( const_cast<MPSCNode<T>*>( next )->get_mutable_value() );
+        guard.clear();
+        Reclaim::retire( const_cast<MPSCNode<T>*>( first ), &destroy );
+        return popped;
+      }
+    }
+  }
+  const MPSCNode<T>* load_first( std::memory_order order_ ) const {
+    return static_cast<const MPSCNode<T>*>( Base::load_first( order_ ) );
+  }
+  static void destroy( void* node_ ) { delete static_cast<MPSCNode<T>*>( node_ ); }
+};
+
+// Intrusive queue
+//
+// Nodes belong to the caller, who may free or re-push a node as soon as it
+// is popped, so consumers take turns on a spin lock instead: a popped node is
+// no longer referenced by the queue or by any other consumer.
+
+template<class T, typename Padding = MPSCDefaultPadding>
+class MPMCIntrQueue : public MPSCIntrQueue<T, Padding>
+{
+  typedef MPSCIntrQueue<T, Padding> Base;
+public:
+  MPMCIntrQueue() : _lock( ATOMIC_FLAG_INIT ) {}
+  const T* pop() {
+    AtomicLockGuard lk( _lock );
+    return Base::pop();
+  }
+  template<typename Backoff = detail::SpinYieldBackoff<>>
+  const T* waiting_pop() {
+    AtomicLockGuard lk( _lock );
+    return Base::template waiting_pop<Backoff>();
+  }
+  template<typename OutputIt>
+  std::size_t pop_bulk( OutputIt out_, std::size_t max_ ) {
+    AtomicLockGuard lk( _lock );
+    return Base::pop_bulk( out_, max_ );
+  }
+  template<typename F>
+  std::size_t consume_all( F f_ ) {
+    AtomicLockGuard lk( _lock );
+    return Base::consume_all( f_ );
+  }
+private:
+  alignas( Padding::alignment ) std::atomic_flag _lock;
+};
+
+} //namespace znl
+
+#endif //ZNL_MPMC_QUEUE_HPP_INCLUDED
@@ -0,0 +1,20 @@
+//  Lock-free MPSC intrusive and non-intrusive queues based on
+//  Vyukov, Dmitry,
+//  http://www.1024cores.net/home/lock-free-algorithms/queues/
+//
+//  Copyright (C) 2018 Zoltan N. Leskowsky
+//
+//  Distributed under the Boost Software License, Version 1.0. (See
+//  accompanying file LICENSE_1_0.txt or copy at
+//  http://www.boost.org/LICENSE_1_0.txt)
+
+#include "mpscqueue.hpp"
+
+namespace znl {
+
+template class MPSCQueueBase<NoPadding>;
+template class MPSCQueueBase<CacheLinePadding<>>;
+template class MPSCIntrQueueBase<NoPadding>;
+template class MPSCIntrQueueBase<CacheLinePadding<>>;
+
+} //namespace znl
@@ -13,6 +13,12 @@
 
 #include <atomic>
 #include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <new>
+#include <thread>
+#include <type_traits>
 #include <utility>
 
 #ifdef BOOST_HAS_PRAGMA_ONCE
@@ -23,30 +29,87 @@
 #if defined(_MSC_VER)
 #endif
 
+// Destructive interference size; x86-64 prefetches cache lines in pairs.
+#ifndef ZNL_CACHELINE_SIZE
+#if defined(__x86_64__) || defined(_M_X64) || defined(__aarch64__)
+#define ZNL_CACHELINE_SIZE 128
+#else
+#define ZNL_CACHELINE_SIZE 64
+#endif
+#endif
+
 
 namespace znl {
 namespace detail {
+
+inline std::uint64_t next_pool_id()
+{
+  static std::atomic<std::uint64_t> id( 0 );
+  return ++id;
+}
+
+inline void cpu_relax()
+{
+#if defined(__GNUC__) && ( defined(__x86_64__) || defined(__i386__) )
+  __builtin_ia32_pause();
+#elif defined(__GNUC__) && defined(__aarch64__)
+  asm volatile( "yield" );
+#endif
+}
+
+// Spins for the first Spins calls, then yields the processor.
+template<unsigned Spins = 128>
+class SpinYieldBackoff
+{
+public:
+  SpinYieldBackoff() : _count( 0 ) {}
+  void operator()() {
+    if( _count < Spins ) {
+      ++_count;
+      cpu_relax();
+    } else {
+      std::this_thread::yield();
+    }
+  }
+private:
+  unsigned _count;
+};
+
+inline void prefetch( const void* p_ )
+{
+#if defined(__GNUC__)
+  __builtin_prefetch( p_ );
+#else
+  ( void ) p_;
+#endif
+}
+
 } //namespace detail
 
+template<typename Padding> class MPSCQueueBase;
+template<typename Padding> class MPSCIntrQueueBase;
+
 class SLinkable
 {
 public:
   SLinkable() = default; // can't be made protected
   SLinkable( const SLinkable& ) : SLinkable() {} //= delete;
   SLinkable( SLinkable&& ) : SLinkable() {} //= delete;
-  SLinkable& operator=( const SLinkable& ) {} //= delete;
-  SLinkable& operator=( SLinkable&& ) {} //= delete;
+  SLinkable& operator=( const SLinkable& ) { return *this; } //= delete;
+  SLinkable& operator=( SLinkable&& ) { return *this; } //= delete;
 protected:
-  friend class MPSCIntrQueueBase;
+  template<typename> friend class MPSCIntrQueueBase;
   const std::atomic<const SLinkable*>* immutable_next() const { return &_next; }
 private:
-  friend class MPSCQueueBase;
+  template<typename> friend class MPSCQueueBase;
   std::atomic<const SLinkable*>* mutable_next() const { return &_next; }
 private:
   mutable std::atomic<const SLinkable*> _next;
 };
 
-template<typename T> class MPSCQueue;
+template<typename T> class MPSCNodeAllocator;
+template<typename T, typename Alloc, typename Padding> class MPSCQueue;
+template<typename T, typename Padding, typename Reclaim> class MPMCQueue;
 
 template<typename T>
 class MPSCNode : public SLinkable
@@ -64,8 +127,9 @@ public:
   const T& get_value() const { return _value; }
 
 private:
-  friend class MPSCQueueBase;
-  friend class MPSCQueue<T>;
+  template<typename> friend class MPSCQueueBase;
+  template<typename, typename, typename> friend class MPSCQueue;
+  template<typename, typename, typename> friend class MPMCQueue;
   T& get_mutable_value() { return _value; }
   T&& get_move_value() & { return std::move( _value ); }
   const MPSCNode* load_next( std::memory_order order_ ) const {
@@ -76,6 +140,27 @@ private:
   T _value;
 };
 
+// Layout policies for MPSCQueueBase: the alignment of _last, written by every
+// producer, and of _first, owned by the consumer. CacheLinePadding keeps them,
+// and whatever a derived queue places after _first, on separate cache lines.
+// It is opt-in: in mpscqueue_test's padding benchmark it cost more than it
+// saved, with 1 and with 4 producers, so the default stays NoPadding.
+
+struct NoPadding
+{
+  static constexpr std::size_t alignment = alignof( std::atomic<const SLinkable*> );
+};
+
+template<std::size_t Size = ZNL_CACHELINE_SIZE>
+struct CacheLinePadding
+{
+  static_assert( Size && ( Size & ( Size - 1 ) ) == 0, "Size must be a power of 2" );
+  static constexpr std::size_t alignment = Size;
+};
+
+using MPSCDefaultPadding = NoPadding;
+
+template<typename Padding = MPSCDefaultPadding>
 class MPSCQueueBase
 {
 protected:
@@ -94,96 +179,511 @@ protected:
   void store_next( const SLinkable& prev_, const SLinkable& linkable_, std::memory_order order_ = std::memory_order_relaxed ) {
     prev_.mutable_next()->store( &linkable_, order_);
   }
+  static void link( const SLinkable& prev_, const SLinkable& next_ ) {
+    prev_.mutable_next()->store( &next_, std::memory_order_relaxed );
+  }
   void push( const SLinkable& linkable_ );
+  // Publishes first_..last_, already linked with link(), with a single
+  // exchange of _last.
+  void push_chain( const SLinkable& first_, const SLinkable& last_ ) {
+    clear_next( last_ );
+    const SLinkable* prev = exchange_last( last_ );
+    store_next( *prev, first_, std::memory_order_release );
+  }
   void store_first( const SLinkable* linkable_, std::memory_order order_ ) { _first.store( linkable_, order_ ); }
   const SLinkable* load_first( std::memory_order order_ ) const { return _first.load( order_ ); }
+  // For multiple consumers only.
+  bool compare_exchange_first( const SLinkable*& expected_, const SLinkable* desired_,
+                               std::memory_order order_ = std::memory_order_acq_rel ) {
+    return _first.compare_exchange_strong( expected_, desired_, order_, std::memory_order_relaxed );
+  }
   const SLinkable* load_last( std::memory_order order_ ) const { return _last.load( order_ ); }
-  //TODO:
-  bool push_in_process() const { return false; }
+  // A producer has exchanged _last but not yet linked its node: the queue
+  // looks empty although it is not.
+  bool push_in_process() const {
+    const SLinkable* first = load_first( std::memory_order_relaxed );
+    return !first->mutable_next()->load( std::memory_order_acquire ) &&
+           first != load_last( std::memory_order_acquire );
+  }
+  // Nothing linked after _first and no push in process.
+  bool is_empty() const {
+    const SLinkable* first = load_first( std::memory_order_relaxed );
+    return !first->mutable_next()->load( std::memory_order_acquire ) &&
+           first == load_last( std::memory_order_acquire );
+  }
 private:
-  std::atomic<const SLinkable*> _last;
-  std::atomic<const SLinkable*> _first;
+  alignas( Padding::alignment ) std::atomic<const SLinkable*> _last;
+  alignas( Padding::alignment ) std::atomic<const SLinkable*> _first;
 };
 
+template<typename Padding>
+MPSCQueueBase<Padding>::MPSCQueueBase( const SLinkable& stub_ )
+{
+  clear_next( stub_ );
+  init( stub_ );
+}
+
+template<typename Padding>
+void MPSCQueueBase<Padding>::push( const SLinkable& linkable_ )
+{
+  clear_next( linkable_ );
+  const SLinkable* prev = exchange_last( linkable_ );
+  store_next( *prev, linkable_, std::memory_order_release );
+}
+
 // Intrusive queue
 
-class MPSCIntrQueueBase : public MPSCQueueBase
+template<typename Padding = MPSCDefaultPadding>
+class MPSCIntrQueueBase : public MPSCQueueBase<Padding>
 {
 protected:
-  MPSCIntrQueueBase() : MPSCQueueBase( _stub ) {}
+  typedef MPSCQueueBase<Padding> Base;
+  MPSCIntrQueueBase() : Base( _stub ) {}
   const SLinkable* pop();
+  // Pops up to max_ linkables in one pass, calling f_ on each, and stores
+  // _first once at the end. f_ may re-push or free the linkable.
+  template<typename F>
+  std::size_t consume( F&& f_, std::size_t max_ ) {
+    const SLinkable* first = this->load_first( std::memory_order_relaxed );
+    std::size_t n = 0;
+    while( n < max_ ) {
+      const SLinkable* next = first->immutable_next()->load( std::memory_order_acquire );
+      if( first == &_stub ) {
+        if( !next ) {
+          break;
+        }
+        first = next;
+        continue;
+      }
+      if( !next ) {
+        if( first != this->load_last( std::memory_order_acquire ) ) {
+          break; // push in process
+        }
+        Base::push( _stub );
+        next = first->immutable_next()->load( std::memory_order_acquire );
+        if( !next ) {
+          break;
+        }
+      }
+      detail::prefetch( next );
+      f_( first );
+      ++n;
+      first = next;
+    }
+    this->store_first( first, std::memory_order_relaxed );
+    return n;
+  }
 private:
   SLinkable _stub;
 };
 
-template<class T>
-class MPSCIntrQueue : public MPSCIntrQueueBase
+template<typename Padding>
+const SLinkable* MPSCIntrQueueBase<Padding>::pop()
 {
+  const SLinkable* first = this->load_first( std::memory_order_relaxed );
+  const SLinkable* next = first->immutable_next()->load( std::memory_order_acquire );
+  if( first == &_stub ) {
+    if( !next ) {
+      return nullptr;
+    }
+    this->store_first( next, std::memory_order_relaxed );
+    first = next;
+    next = first->immutable_next()->load( std::memory_order_acquire );
+  }
+  if( next ) {
+    this->store_first( next, std::memory_order_relaxed );
+    return first;
+  }
+  if( first != this->load_last( std::memory_order_acquire ) ) {
+    return nullptr; // push in process
+  }
+  Base::push( _stub );
+  next = first->immutable_next()->load( std::memory_order_acquire );
+  if( next ) {
+    this->store_first( next, std::memory_order_relaxed );
+    return first;
+  }
+  return nullptr;
+}
+
+extern template class MPSCQueueBase<NoPadding>;
+extern template class MPSCQueueBase<CacheLinePadding<>>;
+extern template class MPSCIntrQueueBase<NoPadding>;
+extern template class MPSCIntrQueueBase<CacheLinePadding<>>;
+
+template<class T, typename Padding = MPSCDefaultPadding>
+class MPSCIntrQueue : public MPSCIntrQueueBase<Padding>
+{
+  typedef MPSCIntrQueueBase<Padding> IntrBase;
+  typedef MPSCQueueBase<Padding> Base;
 public:
   MPSCIntrQueue() = default;
-  void push( const T& val_ ) { MPSCQueueBase::push( val_ ); }
-  const T* pop() { return static_cast<const T*>( MPSCIntrQueueBase::pop() ); }
+  void push( const T& val_ ) { Base::push( val_ ); }
+  // Producer-local linking of a chain for push_chain().
+  static void link( const T& prev_, const T& next_ ) { Base::link( prev_, next_ ); }
+  void push_chain( const T& first_, const T& last_ ) { Base::push_chain( first_, last_ ); }
+  const T* pop() { return static_cast<const T*>( IntrBase::pop() ); }
+  // As pop(), but waits out a push in process rather than reporting empty,
+  // calling Backoff() between attempts.
+  template<typename Backoff = detail::SpinYieldBackoff<>>
+  const T* waiting_pop() {
+    Backoff backoff;
+    const T* val;
+    while( ( val = pop() ) == nullptr && !this->is_empty() ) {
+      backoff();
+    }
+    return val;
+  }
+  template<typename OutputIt>
+  std::size_t pop_bulk( OutputIt out_, std::size_t max_ ) {
+    return this->consume( [&out_] ( const SLinkable* linkable_ ) {
+                      *out_++ = static_cast<const T*>( linkable_ );
+                    }, max_ );
+  }
+  // f_( const T& ) for each element available now; returns the count.
+  template<typename F>
+  std::size_t consume_all( F f_ ) {
+    return this->consume( [&f_] ( const SLinkable* linkable_ ) {
+                      f_( *static_cast<const T*>( linkable_ ) );
+                    }, std::numeric_limits<std::size_t>::max() );
+  }
 };
 
-// Non-intrusive queue
+// Node allocators for the non-intrusive queue
+//
+// An allocator policy provides
+//   template<typename... Args> MPSCNode<T>* allocate( Args&&... );
+//   void deallocate( MPSCNode<T>* );
+// allocate() is called by any producer, deallocate() only by the consumer
+// (or by the queue destructor).
 
 template<typename T>
-class MPSCQueue : public MPSCQueueBase
+class MPSCNodeAllocator
 {
 public:
-  MPSCQueue() : _stub( new MPSCNode<T>() ) { MPSCQueueBase::init( *_stub ); }
+  template<typename... Args>
+  MPSCNode<T>* allocate( Args&&... args_ ) {
+    return new MPSCNode<T>( std::forward<Args>( args_ )... );
+  }
+  void deallocate( MPSCNode<T>* node_ ) { delete node_; }
+};
+
+// Recycling pool of Node objects, which may be MPSCNode<T> or any intrusive
+// node type such as Task: nodes are carved from chunks that live as long as
+// the pool. The consumer collects released nodes privately and publishes them in
+// batches to a shared free stack with one CAS; a producer that runs out of
+// cached nodes takes the whole stack with one exchange into its thread-local
+// cache. Neither operation pops single nodes, so there is no ABA problem.
+// Once warmed up, push/pop make no calls to the global allocator.
+//
+// Thread-local caches are direct-mapped by pool id, CacheSlots per thread per
+// Node type; a colliding pool hands the cached nodes back to their own pool's
+// free stack. The free stack and the chunks live in a reference-counted core
+// that each cache holding nodes keeps alive, so a cache may outlive its pool
+// and is handed back, or freed with the core, when evicted or at thread exit.
+//
+// NodeAlign aligns each node, e.g. to ZNL_CACHELINE_SIZE so that a producer
+// filling one node does not false-share with the consumer reading another.
+// ChunkAlloc provides the chunk memory through
+//   static void* allocate( std::size_t );
+//   static void deallocate( void* );
+
+struct ChunkAllocator
+{
+  static void* allocate( std::size_t size_ ) { return ::operator new( size_ ); }
+  static void deallocate( void* p_ ) { ::operator delete( p_ ); }
+};
+
+template<typename Node, std::size_t ChunkSize = 64, std::size_t CacheSlots = 8,
+         std::size_t NodeAlign = alignof( Node ), typename ChunkAlloc = ChunkAllocator>
+class NodePool
+{
+  static_assert( ChunkSize > 0, "ChunkSize must be positive" );
+  static_assert( CacheSlots > 0, "CacheSlots must be positive" );
+  static constexpr std::size_t node_align =
+    NodeAlign > alignof( Node ) ? NodeAlign : alignof( Node );
+  union Slot {
+    Slot* _next;
+    typename std::aligned_storage<sizeof( Node ), node_align>::type _storage;
+  };
+  struct Chunk {
+    Chunk* _next;
+    void*  _raw;
+    Slot   _slots[ChunkSize];
+  };
+  struct Core {
+    Core() : _free( nullptr ), _chunks( nullptr ), _refs( 1 ) {}
+    Core( const Core& ) = delete;
+    Core& operator=( const Core& ) = delete;
+    ~Core() {
+      Chunk* next;
+      for( Chunk* chunk = _chunks.load( std::memory_order_acquire ); chunk; chunk = next ) {
+        next = chunk->_next;
+        ChunkAlloc::deallocate( chunk->_raw );
+      }
+    }
+    void retain() { _refs.fetch_add( 1, std::memory_order_relaxed ); }
+    void release() {
+      if( _refs.fetch_sub( 1, std::memory_order_acq_rel ) == 1 ) {
+        delete this;
+      }
+    }
+    void push_free( Slot* first_, Slot* last_ ) {
+      Slot* head = _free.load( std::memory_order_relaxed );
+      do {
+        last_->_next = head;
+      } while( !_free.compare_exchange_weak( head, first_,
+                                             std::memory_order_release,
+                                             std::memory_order_relaxed ) );
+    }
+    // A list of unknown length back onto the free stack: it goes on whole
+    // when the stack is empty, else behind whatever was pushed meanwhile,
+    // which is all that is walked.
+    void give_back( Slot* list_ ) {
+      Slot* head = nullptr;
+      while( list_ && !_free.compare_exchange_weak( head, list_,
+                                                    std::memory_order_release,
+                                                    std::memory_order_relaxed ) ) {
+        if( ( head = _free.exchange( nullptr, std::memory_order_acquire ) ) ) {
+          Slot* last = head;
+          while( last->_next ) {
+            last = last->_next;
+          }
+          last->_next = list_;
+          list_ = head;
+        }
+        head = nullptr;
+      }
+    }
+
+    std::atomic<Slot*>       _free;
+    std::atomic<Chunk*>      _chunks;
+    std::atomic<std::size_t> _refs; // the pool's, and each cache's that holds the core
+  };
+  struct Cache {
+    ~Cache() { reset( nullptr ); } // at thread exit
+    void reset( Core* core_ ) {
+      if( _core ) {
+        _core->give_back( _head );
+        _core->release();
+      }
+      if( core_ ) {
+        core_->retain();
+      }
+      _core = core_;
+      _head = nullptr;
+    }
+    Core* _core;
+    Slot* _head;
+  };
+public:
+  static constexpr std::size_t release_batch = ChunkSize / 2 ? ChunkSize / 2 : 1;
+
+  NodePool() : _id( detail::next_pool_id() ), _core( new Core ),
+    _released( nullptr ), _released_last( nullptr ), _released_count( 0 ) {}
+  NodePool( const NodePool& ) = delete;
+  NodePool& operator=( const NodePool& ) = delete;
+  ~NodePool() { _core->release(); }
+  template<typename... Args>
+  Node* allocate( Args&&... args_ ) {
+    Slot* slot = acquire_slot();
+    return new ( &slot->_storage ) Node( std::forward<Args>( args_ )... );
+  }
+  void deallocate( Node* node_ ) {
+    node_->~Node();
+    Slot* slot = reinterpret_cast<Slot*>( node_ );
+    slot->_next = _released;
+    if( !_released ) {
+      _released_last = slot;
+    }
+    _released = slot;
+    if( ++_released_count >= release_batch ) {
+      publish_released();
+    }
+  }
+  // deallocate() for any thread: one CAS onto the shared free stack, which
+  // producers only ever take whole.
+  void deallocate_shared( Node* node_ ) {
+    node_->~Node();
+    Slot* slot = reinterpret_cast<Slot*>( node_ );
+    _core->push_free( slot, slot );
+  }
+  // Carves chunks for at least n_ more nodes now, e.g. from a thread bound to
+  // the consumer's NUMA node so that their pages are first touched there.
+  // Any thread.
+  void reserve( std::size_t n_ ) {
+    for( std::size_t i = 0; i < n_; i += ChunkSize ) {
+      Slot* first = new_chunk();
+      _core->push_free( first, first + ChunkSize - 1 );
+    }
+  }
+
+private:
+  Slot* acquire_slot() {
+    Cache& cache = _caches[_id % CacheSlots];
+    if( cache._core != _core ) {
+      cache.reset( _core ); // hands another pool's nodes back
+    }
+    Slot* slot = cache._head;
+    if( !slot ) {
+      slot = _core->_free.exchange( nullptr, std::memory_order_acquire );
+      if( !slot ) {
+        slot = new_chunk();
+      }
+    }
+    cache._head = slot->_next;
+    return slot;
+  }
+  Slot* new_chunk() {
+    // operator new is not alignment-aware before C++17
+    void* raw = ChunkAlloc::allocate( sizeof( Chunk ) + alignof( Chunk ) - 1 );
+    std::size_t space = sizeof( Chunk ) + alignof( Chunk ) - 1;
+    void* aligned = raw;
+    Chunk* chunk = static_cast<Chunk*>( std::align( alignof( Chunk ), sizeof( Chunk ), aligned, space ) );
+    chunk->_raw = raw;
+    for( std::size_t i = 0; i + 1 < ChunkSize; ++i ) {
+      chunk->_slots[i]._next = &chunk->_slots[i + 1];
+    }
+    chunk->_slots[ChunkSize - 1]._next = nullptr;
+    chunk->_next = _core->_chunks.load( std::memory_order_relaxed );
+    while( !_core->_chunks.compare_exchange_weak( chunk->_next, chunk,
+                                                  std::memory_order_release,
+                                                  std::memory_order_relaxed ) ) ;
+    return &chunk->_slots[0];
+  }
+  void publish_released() {
+    _core->push_free( _released, _released_last );
+    _released = _released_last = nullptr;
+    _released_count = 0;
+  }
+
+private:
+  static thread_local Cache _caches[CacheSlots];
+  const std::uint64_t _id;
+  Core* const         _core;
+  // consumer-owned
+  Slot*               _released;
+  Slot*               _released_last;
+  std::size_t         _released_count;
+};
+
+template<typename Node, std::size_t ChunkSize, std::size_t CacheSlots, std::size_t NodeAlign,
+         typename ChunkAlloc>
+constexpr std::size_t NodePool<Node, ChunkSize, CacheSlots, NodeAlign, ChunkAlloc>::release_batch;
+
+template<typename Node, std::size_t ChunkSize, std::size_t CacheSlots, std::size_t NodeAlign,
+         typename ChunkAlloc>
+thread_local typename NodePool<Node, ChunkSize, CacheSlots, NodeAlign, ChunkAlloc>::Cache
+  NodePool<Node, ChunkSize, CacheSlots, NodeAlign, ChunkAlloc>::_caches[CacheSlots];
+
+template<typename T, std::size_t ChunkSize = 64, std::size_t CacheSlots = 8,
+         std::size_t NodeAlign = alignof( MPSCNode<T> ), typename ChunkAlloc = ChunkAllocator>
+using MPSCNodePool = NodePool<MPSCNode<T>, ChunkSize, CacheSlots, NodeAlign, ChunkAlloc>;
+
+// Non-intrusive queue
+
+template<typename T, typename Alloc = MPSCNodePool<T>, typename Padding = MPSCDefaultPadding>
+class MPSCQueue : public MPSCQueueBase<Padding>
+{
+  typedef MPSCQueueBase<Padding> Base;
+public:
+  MPSCQueue() : _stub( _alloc.allocate() ) { Base::init( *_stub ); }
   ~MPSCQueue() {
     MPSCNode<T>* first = const_cast<MPSCNode<T>*>( load_first( std::memory_order_relaxed ) );
     MPSCNode<T>* next;
     for( MPSCNode<T>* node = first; node; node = next ) {
       next = const_cast<MPSCNode<T>*>( node->load_next( std::memory_order_relaxed ) );
-      delete node;
+      _alloc.deallocate( node );
       if( next == first ) {
         break;
       }
     }
   }
   void push( const T& value_ ) {
-    MPSCQueueBase::push( *new MPSCNode<T>( value_ ) );
+    Base::push( *_alloc.allocate( value_ ) );
   }
   void push( T&& value_ ) {
-    MPSCQueueBase::push( *new MPSCNode<T>( std::move( value_ ) ) );
+    Base::push( *_alloc.allocate( std::move( value_ ) ) );
+  }
+  // Pushes the values of [first_, last_) with a single exchange of _last.
+  template<typename InputIt>
+  void push_chain( InputIt first_, InputIt last_ ) {
+    if( first_ == last_ ) {
+      return;
+    }
+    MPSCNode<T>* head = _alloc.allocate( *first_ );
+    MPSCNode<T>* tail = head;
+    for( ++first_; first_ != last_; ++first_ ) {
+      MPSCNode<T>* node = _alloc.allocate( *first_ );
+      Base::link( *tail, *node );
+      tail = node;
+    }
+    Base::push_chain( *head, *tail );
   }
   bool pop( T& value_ ) {
     MPSCNode<T>* first = const_cast<MPSCNode<T>*>( load_first( std::memory_order_relaxed ) );
     MPSCNode<T>* next = const_cast<MPSCNode<T>*>( first->load_next( std::memory_order_acquire ) );
     if( next ) {
-      store_first( next, std::memory_order_relaxed );
+      this->store_first( next, std::memory_order_relaxed );
       assign_or_move( value_, next->get_mutable_value() );
-      delete first;
+      _alloc.deallocate( first );
       return true;
     }
     return false;
   }
+  // Moves up to max_ values to out_ in one pass; returns the count.
+  template<typename OutputIt>
+  std::size_t pop_bulk( OutputIt out_, std::size_t max_ ) {
+    return consume( [&out_] ( T& value_ ) { *out_++ = std::move( value_ ); }, max_ );
+  }
+  // f_( T& ) for each element available now; returns the count.
+  template<typename F>
+  std::size_t consume_all( F f_ ) {
+    return consume( f_, std::numeric_limits<std::size_t>::max() );
+  }
+  // As pop(), but waits out a push in process rather than reporting empty,
+  // calling Backoff() between attempts.
+  template<typename Backoff = detail::SpinYieldBackoff<>>
   bool waiting_pop( T& value_ ) {
-    do {
-      MPSCNode<T>* first = const_cast<MPSCNode<T>*>( load_first( std::memory_order_relaxed ) );
-      MPSCNode<T>* next = const_cast<MPSCNode<T>*>( first->load_next( std::memory_order_acquire ) );
-      if( next ) {
-        store_first( next, std::memory_order_relaxed );
-        assign_or_move( value_, next->get_mutable_value() );
-        delete first;
-        return true;
+    Backoff backoff;
+    while( !pop( value_ ) ) {
+      if( this->is_empty() ) {
+        return false;
       }
-    } while( push_in_process() );
-    return false;
+      backoff();
+    }
+    return true;
   }
 private:
+  template<typename F>
+  std::size_t consume( F&& f_, std::size_t max_ ) {
+    MPSCNode<T>* first = const_cast<MPSCNode<T>*>( load_first( std::memory_order_relaxed ) );
+    std::size_t n = 0;
+    MPSCNode<T>* next;
+    while( n < max_ &&
+           ( next = const_cast<MPSCNode<T>*>( first->load_next( std::memory_order_acquire ) ) ) ) {
+      detail::prefetch( next->load_next( std::memory_order_relaxed ) );
+      f_( next->get_mutable_value() );
+      _alloc.deallocate( first );
+      first = next;
+      ++n;
+    }
+    if( n ) {
+      this->store_first( first, std::memory_order_relaxed );
+    }
+    return n;
+  }
   inline static void assign_value( T& to_, T& from_ ) { to_ = from_; }
   inline static void move_value( T& to_, T& from_ ) { to_ = std::move( from_ ); }
   inline static void swap_value( T& to_, T& from_ ) { std::swap( to_, from_ ); }
   // override for particular T where more efficient:
   inline static void assign_or_move( T& to_, T& from_ ) { move_value( to_, from_ ); }
   const MPSCNode<T>* load_first( std::memory_order order_ ) const {
-    return static_cast<const MPSCNode<T>*>( MPSCQueueBase::load_first( order_ ) );
+    return static_cast<const MPSCNode<T>*>( Base::load_first( order_ ) );
   }
   //inline static bool is_valued( const T& val_ ) { return false; }
 private:
+  alignas( Padding::alignment ) Alloc _alloc; // off the consumer's line
   const MPSCNode<T>*  _stub;
 };
 
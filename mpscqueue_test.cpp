@@ -8,14 +8,34 @@
 //  accompanying file LICENSE_1_0.txt or copy at
 //  http://www.boost.org/LICENSE_1_0.txt)
 
+#include "boundedmpscqueue.hpp"
+#include "chaselevdeque.hpp"
+#include "mpmcqueue.hpp"
 #include "mpscqueue.hpp"
+#include "priorityqueue.hpp"
+#include "reclaim.hpp"
+#include "segmentedqueue.hpp"
+#include "shardedqueue.hpp"
+#include "shmqueue.hpp"
+#include "waitstrategy.hpp"
+#include "spscqueue.hpp"
+#include "timerwheel.hpp"
 #include <atomic>
 #include <cassert>
+#include <chrono>
+#include <cstdlib>
 #include <cstring>
+#include <ctime>
 #include <future>
 #include <iostream>
+#include <new>
 #include <string>
 #include <thread>
+#include <vector>
+
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <unistd.h>
 
 using namespace std;
 using namespace znl;
@@ -29,7 +49,440 @@ public:
 };
 
 using IntrIntQueue = MPSCIntrQueue<IntNode>;
+
+// Splits push() to expose the window between exchanging _last and linking.
+class SplitPushQueue : public IntrIntQueue
+{
+public:
+  const SLinkable* begin_push( const IntNode& node_ ) {
+    clear_next( node_ );
+    return exchange_last( node_ );
+  }
+  void end_push( const SLinkable* prev_, const IntNode& node_ ) {
+    store_next( *prev_, node_, std::memory_order_release );
+  }
+  bool in_process() const { return push_in_process(); }
+};
 using IntQueue = MPSCQueue<int>;
+using BoundedIntQueue = BoundedMPSCQueue<int, 1024>;
+using PaddedIntQueue = MPSCQueue<int, MPSCNodePool<int, 64, 8, ZNL_CACHELINE_SIZE>, CacheLinePadding<>>;
+using UnpaddedIntQueue = MPSCQueue<int, MPSCNodePool<int>, NoPadding>;
+
+static inline unsigned long long cycles()
+{
+#if defined(__GNUC__) && ( defined(__x86_64__) || defined(__i386__) )
+  return __builtin_ia32_rdtsc();
+#else
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+           std::chrono::steady_clock::now().time_since_epoch() ).count();
+#endif
+}
+
+// Calls to the global allocator made by the queues built on these
+static std::atomic<long> allocs( 0 );
+
+struct CountingChunkAllocator : ChunkAllocator
+{
+  static void* allocate( std::size_t size_ ) {
+    ++allocs;
+    return ChunkAllocator::allocate( size_ );
+  }
+};
+
+template<typename T>
+struct CountingNodeAllocator : MPSCNodeAllocator<T>
+{
+  template<typename... Args>
+  MPSCNode<T>* allocate( Args&&... args_ ) {
+    ++allocs;
+    return MPSCNodeAllocator<T>::allocate( std::forward<Args>( args_ )... );
+  }
+};
+
+using CountingIntPool = MPSCNodePool<int, 64, 8, alignof( MPSCNode<int> ), CountingChunkAllocator>;
+using CountedIntQueue = MPSCQueue<int, CountingIntPool>;
+using CountedPlainIntQueue = MPSCQueue<int, CountingNodeAllocator<int>>;
+
+void bench_bursts( int nthr_, int nitem_, int burst_ )
+{
+  IntQueue queue;
+  const int per_thread = nitem_ / nthr_ / burst_ * burst_;
+  const long total = static_cast<long>( per_thread ) * nthr_;
+  std::vector<std::thread> producers;
+  producers.reserve( nthr_ );
+  const auto t0 = std::chrono::steady_clock::now();
+  for( int t = 0; t < nthr_; ++t ) {
+    producers.emplace_back( [&queue, per_thread, burst_] () {
+                              std::vector<int> burst( burst_ );
+                              for( int j = 0; j < per_thread; j += burst_ ) {
+                                for( int k = 0; k < burst_; ++k ) {
+                                  burst[k] = j + k;
+                                }
+                                if( burst_ == 1 ) {
+                                  queue.push( burst[0] );
+                                } else {
+                                  queue.push_chain( burst.begin(), burst.end() );
+                                }
+                              }
+                            } );
+  }
+  long popped = 0;
+  int value;
+  while( popped < total ) {
+    if( queue.pop( value ) ) {
+      ++popped;
+    } else {
+      std::this_thread::yield();
+    }
+  }
+  const auto t1 = std::chrono::steady_clock::now();
+  for( auto& producer : producers ) {
+    producer.join();
+  }
+  const double ns = std::chrono::duration<double, std::nano>( t1 - t0 ).count();
+  cout << "burst " << burst_ << " " << nthr_ << " producers: "
+       << ( ns / total ) << " ns/item" << endl;
+}
+
+// Producers and the consumer hammer _last and _first concurrently; reports
+// cycles per push or pop.
+template<typename Queue>
+void bench_padding( const char* name_, int nthr_, int nitem_ )
+{
+  Queue queue;
+  const int per_thread = nitem_ / nthr_;
+  const long total = static_cast<long>( per_thread ) * nthr_;
+  std::vector<std::thread> producers;
+  producers.reserve( nthr_ );
+  const unsigned long long c0 = cycles();
+  for( int t = 0; t < nthr_; ++t ) {
+    producers.emplace_back( [&queue, per_thread] () {
+                              for( int j = 0; j < per_thread; ++j ) {
+                                queue.push( j );
+                              }
+                            } );
+  }
+  long popped = 0;
+  int value;
+  while( popped < total ) {
+    if( queue.pop( value ) ) {
+      ++popped;
+    } else {
+      std::this_thread::yield();
+    }
+  }
+  const unsigned long long c1 = cycles();
+  for( auto& producer : producers ) {
+    producer.join();
+  }
+  cout << name_ << " " << nthr_ << " producers: "
+       << ( static_cast<double>( c1 - c0 ) / ( 2 * total ) ) << " cycles/op" << endl;
+}
+
+// nthr_ producers feed ncons_ consumers through one MPMCQueue, or through
+// ncons_ MPSCQueues with producers spreading items round-robin.
+void bench_consumers( bool shared_, int nthr_, int ncons_, int nitem_ )
+{
+  MPMCQueue<int> mpmc;
+  std::vector<IntQueue> mpscs( ncons_ );
+  const int per_thread = nitem_ / nthr_ / ncons_ * ncons_;
+  const long total = static_cast<long>( per_thread ) * nthr_;
+  std::atomic<long> popped( 0 );
+  std::atomic<long> sum( 0 );
+  std::vector<std::thread> threads;
+  threads.reserve( nthr_ + ncons_ );
+  const auto t0 = std::chrono::steady_clock::now();
+  for( int c = 0; c < ncons_; ++c ) {
+    threads.emplace_back( [&, c] () {
+                            int value;
+                            long n = 0;
+                            long s = 0;
+                            const long own = total / ncons_;
+                            while( shared_ ? popped.load( std::memory_order_relaxed ) < total : n < own ) {
+                              if( shared_ ? mpmc.pop( value ) : mpscs[c].pop( value ) ) {
+                                s += value;
+                                ++n;
+                                if( shared_ ) {
+                                  ++popped;
+                                }
+                              } else {
+                                std::this_thread::yield();
+                              }
+                            }
+                            sum += s;
+                          } );
+  }
+  for( int t = 0; t < nthr_; ++t ) {
+    threads.emplace_back( [&, per_thread] () {
+                            for( int j = 0; j < per_thread; ++j ) {
+                              if( shared_ ) {
+                                mpmc.push( j );
+                              } else {
+                                mpscs[j % ncons_].push( j );
+                              }
+                            }
+                          } );
+  }
+  for( auto& thread : threads ) {
+    thread.join();
+  }
+  const auto t1 = std::chrono::steady_clock::now();
+  assert( sum == static_cast<long>( per_thread - 1 ) * per_thread / 2 * nthr_ );
+  const double ns = std::chrono::duration<double, std::nano>( t1 - t0 ).count();
+  cout << ( shared_ ? "1 MPMC " : "N MPSC " ) << nthr_ << " producers, "
+       << ncons_ << " consumers: " << ( ns / total ) << " ns/item" << endl;
+}
+
+// Reports allocs/item for queues that count their allocations.
+template<typename Queue>
+void bench_producers( const char* name_, int nthr_, int nitem_, bool counted_ = false )
+{
+  Queue queue;
+  const int per_thread = nitem_ / nthr_;
+  const long total = static_cast<long>( per_thread ) * nthr_;
+  std::vector<std::thread> producers;
+  producers.reserve( nthr_ );
+  const long allocs0 = allocs.load();
+  const auto t0 = std::chrono::steady_clock::now();
+  for( int t = 0; t < nthr_; ++t ) {
+    producers.emplace_back( [&queue, per_thread] () {
+                              for( int j = 0; j < per_thread; ++j ) {
+                                queue.push( j );
+                              }
+                            } );
+  }
+  long popped = 0;
+  long sum = 0;
+  int value;
+  while( popped < total ) {
+    if( queue.pop( value ) ) {
+      sum += value;
+      ++popped;
+    } else {
+      std::this_thread::yield();
+    }
+  }
+  const auto t1 = std::chrono::steady_clock::now();
+  for( auto& producer : producers ) {
+    producer.join();
+  }
+  const long nallocs = allocs.load() - allocs0;
+  assert( sum == static_cast<long>( per_thread - 1 ) * per_thread / 2 * nthr_ );
+  const double ns = std::chrono::duration<double, std::nano>( t1 - t0 ).count();
+  cout << name_ << " " << nthr_ << " producers: " << ( ns / total ) << " ns/item";
+  if( counted_ ) {
+    cout << ", " << ( static_cast<double>( nallocs ) / total ) << " allocs/item";
+  }
+  cout << endl;
+}
+
+// Producers push in bursts with pauses between them, so the consumer keeps
+// running out of work; reports its latency against the CPU time it burns.
+template<typename Wait>
+void bench_wait( const char* name_, int nthr_, int nitem_ )
+{
+  MPSCQueue<int> queue;
+  Wait wait;
+  const int per_thread = nitem_ / nthr_;
+  const long total = static_cast<long>( per_thread ) * nthr_;
+  std::vector<std::thread> producers;
+  const auto t0 = std::chrono::steady_clock::now();
+  for( int t = 0; t < nthr_; ++t ) {
+    producers.emplace_back( [&queue, &wait, per_thread] () {
+                              for( int j = 0; j < per_thread; ++j ) {
+                                queue.push( j );
+                                wait.notify();
+                                if( j % 256 == 255 ) {
+                                  std::this_thread::sleep_for( std::chrono::microseconds( 200 ) );
+                                }
+                              }
+                            } );
+  }
+  timespec cpu0, cpu1;
+  ::clock_gettime( CLOCK_THREAD_CPUTIME_ID, &cpu0 );
+  long sum = 0;
+  int value;
+  for( long n = 0; n < total; ++n ) {
+    wait.wait( [&queue, &value] () {
+                 return queue.template waiting_pop<typename Wait::Backoff>( value );
+               } );
+    sum += value;
+  }
+  ::clock_gettime( CLOCK_THREAD_CPUTIME_ID, &cpu1 );
+  const auto t1 = std::chrono::steady_clock::now();
+  for( auto& producer : producers ) {
+    producer.join();
+  }
+  assert( sum == static_cast<long>( per_thread - 1 ) * per_thread / 2 * nthr_ );
+  assert( !queue.pop( value ) );
+  const double ns = std::chrono::duration<double, std::nano>( t1 - t0 ).count();
+  const double cpu_ns = ( cpu1.tv_sec - cpu0.tv_sec ) * 1e9 + ( cpu1.tv_nsec - cpu0.tv_nsec );
+  cout << name_ << " " << nthr_ << " producers: " << ( ns / total ) << " ns/item, consumer CPU "
+       << ( 100 * cpu_ns / ns ) << "%" << endl;
+}
+
+// Readers dereference a shared object that writers keep replacing and
+// retiring; a reader that sees a reclaimed object fails the magic check, or
+// races with the deleter under -fsanitize=thread. Reports the time from
+// retire() to reclamation.
+struct Reclaimable
+{
+  static constexpr int live = 0x11fe;
+  static std::atomic<long> retired, reclaimed, total_ns, max_ns;
+  explicit Reclaimable( int value_ ) : magic( live ), value( value_ ) {}
+  static void reclaim( void* p_ ) {
+    Reclaimable* obj = static_cast<Reclaimable*>( p_ );
+    const long ns = static_cast<long>( std::chrono::duration<double, std::nano>(
+                      std::chrono::steady_clock::now() - obj->retired_at ).count() );
+    total_ns += ns;
+    long max = max_ns.load();
+    while( ns > max && !max_ns.compare_exchange_weak( max, ns ) ) ;
+    ++reclaimed;
+    obj->magic = 0;
+    delete obj;
+  }
+  int magic;
+  int value;
+  std::chrono::steady_clock::time_point retired_at;
+};
+std::atomic<long> Reclaimable::retired( 0 ), Reclaimable::reclaimed( 0 ),
+                  Reclaimable::total_ns( 0 ), Reclaimable::max_ns( 0 );
+
+template<typename Domain>
+void stress_reclaim( const char* name_, int nreaders_, int nwriters_, int nswaps_ )
+{
+  Reclaimable::retired = Reclaimable::reclaimed = 0;
+  Reclaimable::total_ns = Reclaimable::max_ns = 0;
+  std::atomic<Reclaimable*> shared( new Reclaimable( 0 ) );
+  std::atomic<bool> done( false );
+  std::atomic<long> reads( 0 );
+  std::vector<std::thread> threads;
+  for( int r = 0; r < nreaders_; ++r ) {
+    threads.emplace_back( [&] () {
+                            long n = 0;
+                            while( !done.load( std::memory_order_relaxed ) ) {
+                              typename Domain::Guard guard;
+                              Reclaimable* obj = guard.hold( 0, shared.load() );
+                              if( obj != shared.load() ) {
+                                continue;
+                              }
+                              assert( obj->magic == Reclaimable::live && obj->value >= 0 );
+                              ++n;
+                            }
+                            reads += n;
+                          } );
+  }
+  for( int w = 0; w < nwriters_; ++w ) {
+    threads.emplace_back( [&] () {
+                            for( int j = 1; j <= nswaps_; ++j ) {
+                              Reclaimable* old = shared.exchange( new Reclaimable( j ) );
+                              old->retired_at = std::chrono::steady_clock::now();
+                              ++Reclaimable::retired;
+                              Domain::retire( old, &Reclaimable::reclaim );
+                              if( ( j & 63 ) == 0 ) {
+                                std::this_thread::yield();
+                              }
+                            }
+                          } );
+  }
+  for( int w = 0; w < nwriters_; ++w ) {
+    threads[nreaders_ + w].join();
+  }
+  done = true;
+  for( int r = 0; r < nreaders_; ++r ) {
+    threads[r].join();
+  }
+  for( int i = 0; i < 3; ++i ) {
+    Domain::collect(); // adopts what exited threads left, lets epochs advance
+  }
+  assert( Reclaimable::reclaimed == Reclaimable::retired );
+  delete shared.load();
+  cout << name_ << " " << nreaders_ << " readers, " << nwriters_ << " writers: "
+       << reads.load() << " reads, " << Reclaimable::reclaimed.load() << " reclaimed, latency "
+       << ( Reclaimable::total_ns.load() / Reclaimable::reclaimed.load() / 1000 ) << " us avg, "
+       << ( Reclaimable::max_ns.load() / 1000 ) << " us max" << endl;
+}
+
+// nproc_ forked producer processes send nitem_ values in all to this
+// process, through a ShmMPSCQueue or a Unix-domain datagram socket.
+void bench_processes( bool shm_, int nproc_, int nitem_ )
+{
+  ShmMPSCQueue<int, 1024> queue;
+  int sv[2];
+  if( !shm_ ) {
+    const int rc = ::socketpair( AF_UNIX, SOCK_DGRAM, 0, sv );
+    assert( rc == 0 );
+    ( void ) rc;
+  }
+  const int per_proc = nitem_ / nproc_;
+  const long total = static_cast<long>( per_proc ) * nproc_;
+  std::vector<pid_t> children;
+  const auto t0 = std::chrono::steady_clock::now();
+  for( int p = 0; p < nproc_; ++p ) {
+    const pid_t pid = ::fork();
+    assert( pid >= 0 );
+    if( pid == 0 ) {
+      for( int j = 0; j < per_proc; ++j ) {
+        const int value = ( p << 20 ) | j;
+        if( shm_ ) {
+          queue.push( value );
+        } else if( ::send( sv[1], &value, sizeof( value ), 0 ) != sizeof( value ) ) {
+          ::_exit( 1 );
+        }
+      }
+      ::_exit( 0 );
+    }
+    children.push_back( pid );
+  }
+  std::vector<int> nexts( nproc_, 0 );
+  for( long n = 0; n < total; ++n ) {
+    int value;
+    if( shm_ ) {
+      while( !queue.waiting_pop( value ) ) {
+        std::this_thread::yield();
+      }
+    } else {
+      const ssize_t len = ::recv( sv[0], &value, sizeof( value ), 0 );
+      assert( len == sizeof( value ) );
+      ( void ) len;
+    }
+    assert( ( value & 0xfffff ) == nexts[value >> 20]++ ); // FIFO per producer
+  }
+  const auto t1 = std::chrono::steady_clock::now();
+  for( pid_t pid : children ) {
+    int status;
+    ::waitpid( pid, &status, 0 );
+    assert( WIFEXITED( status ) && WEXITSTATUS( status ) == 0 );
+  }
+  if( !shm_ ) {
+    ::close( sv[0] );
+    ::close( sv[1] );
+  }
+  int value;
+  assert( !queue.pop( value ) );
+  ( void ) value;
+  const double ns = std::chrono::duration<double, std::nano>( t1 - t0 ).count();
+  cout << ( shm_ ? "shm   " : "socket" ) << " " << nproc_ << " processes: "
+       << ( ns / total ) << " ns/item" << endl;
+}
+
+// Consumer side only: drains a queue filled beforehand.
+template<typename Queue>
+void bench_drain( const char* name_, int nitem_ )
+{
+  Queue queue;
+  for( int j = 0; j < nitem_; ++j ) {
+    queue.push( j );
+  }
+  long sum = 0;
+  const auto t0 = std::chrono::steady_clock::now();
+  const std::size_t n = queue.consume_all( [&sum] ( int& value_ ) { sum += value_; } );
+  const auto t1 = std::chrono::steady_clock::now();
+  assert( n == static_cast<std::size_t>( nitem_ ) );
+  assert( sum == static_cast<long>( nitem_ - 1 ) * nitem_ / 2 );
+  const double ns = std::chrono::duration<double, std::nano>( t1 - t0 ).count();
+  cout << name_ << " drain: " << ( ns / nitem_ ) << " ns/item" << endl;
+}
 
 int main()
 {
@@ -216,4 +669,478 @@ int main()
   cout << "awaited " << NTHR << " threads" << endl;
   cout << "Intrusive null-count: " << inullcount << endl;
   cout << "Non-intrusive null-count: " << ninullcount << endl;
+
+  cout << "Node allocator benchmark ..." << endl;
+  for( int nthr = 1; nthr <= 32; nthr *= 2 ) {
+    bench_producers<CountedPlainIntQueue>( "plain ", nthr, 1 << 17, true );
+    bench_producers<CountedIntQueue>( "pooled", nthr, 1 << 17, true );
+  }
+
+  cout << "Node pool steady state test ..." << endl;
+  {
+    // three pools per thread-local cache slot, so each push evicts another's nodes
+    CountedIntQueue queues[24];
+    auto cycle = [&queues] ( int rounds_ ) {
+                   int value;
+                   for( int r = 0; r < rounds_; ++r ) {
+                     for( CountedIntQueue& queue : queues ) {
+                       queue.push( r );
+                       bool popped = queue.pop( value );
+                       assert( popped && value == r );
+                       (void)popped;
+                     }
+                   }
+                 };
+    cycle( 1000 );
+    const long before = allocs.load();
+    cycle( 10000 );
+    const long after = allocs.load();
+    cout << "allocations after warm-up: " << after - before << endl;
+    assert( after == before );
+  }
+
+  cout << "Bounded queue benchmark ..." << endl;
+  for( int nthr = 1; nthr <= 16; nthr *= 4 ) {
+    bench_producers<CountedIntQueue>( "linked ", nthr, 1 << 17, true );
+    bench_producers<BoundedIntQueue>( "bounded", nthr, 1 << 17 ); // allocates nothing
+  }
+  {
+    // waiting_pop() reports empty only when no slot is claimed, so with the
+    // producers done it drains the ring, each producer's values in order
+    static_assert( alignof( BoundedIntQueue ) == ZNL_CACHELINE_SIZE, "BoundedMPSCQueue padding" );
+    BoundedIntQueue bqueue;
+    const int nprod = 4, per_producer = 1 << 15;
+    std::atomic<int> done( 0 );
+    std::vector<std::thread> producers;
+    for( int t = 0; t < nprod; ++t ) {
+      producers.emplace_back( [&bqueue, &done, t, per_producer] () {
+                                for( int j = 0; j < per_producer; ++j ) {
+                                  bqueue.push( t * per_producer + j );
+                                }
+                                ++done;
+                              } );
+    }
+    std::vector<int> next( nprod, 0 );
+    long popped = 0;
+    int value;
+    for( ;; ) {
+      const bool finished = done == nprod;
+      if( bqueue.waiting_pop( value ) ) {
+        const int t = value / per_producer;
+        assert( value % per_producer == next[t] );
+        ++next[t];
+        ++popped;
+      } else if( finished ) {
+        break;
+      } else {
+        std::this_thread::yield();
+      }
+    }
+    for( auto& producer : producers ) {
+      producer.join();
+    }
+    assert( popped == static_cast<long>( nprod ) * per_producer && bqueue.is_empty() );
+    cout << "bounded waiting_pop: " << popped << " popped in order" << endl;
+  }
+
+  cout << "Chain push tests ..." << endl;
+  IntrIntQueue ichqueue;
+  for( i = 1; i < 4; ++i ) {
+    IntrIntQueue::link( ins[i - 1], ins[i] );
+  }
+  ichqueue.push_chain( ins[0], ins[3] );
+  ichqueue.push( ins[4] );
+  for( i = 0; ( pi = ichqueue.pop() ) != nullptr; ++i ) {
+    assert( pi == &ins[i] );
+    cout << static_cast<char>( pi->get_value() );
+  }
+  assert( i == 5 );
+  IntQueue chqueue;
+  chqueue.push_chain( is, is + NITEM );
+  for( i = 0; chqueue.pop( ni ); ++i ) {
+    assert( ni == is[i] );
+    cout << static_cast<char>( ni );
+  }
+  assert( i == NITEM );
+  cout << endl;
+
+  cout << "Bulk pop tests ..." << endl;
+  for( i = 1; i < NITEM; ++i ) {
+    IntrIntQueue::link( ins[i - 1], ins[i] );
+  }
+  ichqueue.push_chain( ins[0], ins[NITEM - 1] );
+  const IntNode* pis[NITEM];
+  size_t nbulk = ichqueue.pop_bulk( pis, 10 );
+  assert( nbulk == 10 );
+  size_t k = nbulk;
+  nbulk += ichqueue.consume_all( [&pis, &k] ( const IntNode& node_ ) { pis[k++] = &node_; } );
+  assert( nbulk == NITEM );
+  for( i = 0; i < NITEM; ++i ) {
+    assert( pis[i] == &ins[i] );
+    cout << static_cast<char>( pis[i]->get_value() );
+  }
+  chqueue.push_chain( is, is + NITEM );
+  int nis[NITEM];
+  nbulk = chqueue.pop_bulk( nis, 10 );
+  assert( nbulk == 10 );
+  k = nbulk;
+  nbulk += chqueue.consume_all( [&nis, &k] ( int& value_ ) { nis[k++] = value_; } );
+  assert( nbulk == NITEM );
+  for( i = 0; i < NITEM; ++i ) {
+    assert( nis[i] == is[i] );
+    cout << static_cast<char>( nis[i] );
+  }
+  assert( !chqueue.pop( ni ) && !ichqueue.pop() );
+  cout << endl;
+
+  cout << "Push in process tests ..." << endl;
+  SplitPushQueue spqueue;
+  spqueue.push( ins[0] );
+  const SLinkable* prev = spqueue.begin_push( ins[1] );
+  assert( spqueue.pop() == nullptr && spqueue.in_process() );
+  std::future<void> linker = std::async( std::launch::async,
+                                         [&spqueue, &ins, prev] () {
+                                           std::this_thread::sleep_for( std::chrono::milliseconds( 10 ) );
+                                           spqueue.end_push( prev, ins[1] );
+                                         } );
+  assert( spqueue.waiting_pop() == &ins[0] );
+  assert( spqueue.waiting_pop() == &ins[1] );
+  assert( !spqueue.in_process() && spqueue.waiting_pop() == nullptr );
+  linker.wait();
+  cout << "waited for linked push" << endl;
+
+  cout << "Chain push benchmark ..." << endl;
+  for( int nthr = 1; nthr <= 16; nthr *= 4 ) {
+    bench_bursts( nthr, 1 << 17, 1 );
+    bench_bursts( nthr, 1 << 17, 64 );
+    bench_bursts( nthr, 1 << 17, 1024 );
+  }
+
+  cout << "False sharing benchmark (padding " << ZNL_CACHELINE_SIZE << ") ..." << endl;
+  cout << "sizeof padded/unpadded queue: " << sizeof( PaddedIntQueue )
+       << "/" << sizeof( UnpaddedIntQueue ) << endl;
+  for( int nthr = 1; nthr <= 4; nthr *= 4 ) {
+    bench_padding<UnpaddedIntQueue>( "unpadded", nthr, 1 << 18 );
+    bench_padding<PaddedIntQueue>( "padded  ", nthr, 1 << 18 );
+  }
+
+  cout << "MPMC queue tests ..." << endl;
+  MPMCIntrQueue<IntNode> imqueue;
+  imqueue.push( ins[0] );
+  imqueue.push( ins[1] );
+  assert( imqueue.pop() == &ins[0] && imqueue.waiting_pop() == &ins[1] && !imqueue.pop() );
+  MPMCQueue<int> mqueue;
+  mqueue.push( 1 );
+  mqueue.push( 2 );
+  assert( mqueue.pop( ni ) && ni == 1 && mqueue.waiting_pop( ni ) && ni == 2 && !mqueue.pop( ni ) );
+  MPMCQueue<int, MPSCDefaultPadding, EpochReclaim> equeue;
+  equeue.push( 1 );
+  equeue.push( 2 );
+  assert( equeue.pop( ni ) && ni == 1 && equeue.waiting_pop( ni ) && ni == 2 && !equeue.pop( ni ) );
+  cout << "MPMC contention benchmark ..." << endl;
+  for( int ncons = 1; ncons <= 4; ncons *= 2 ) {
+    bench_consumers( true, 4, ncons, 1 << 17 );
+    bench_consumers( false, 4, ncons, 1 << 17 );
+  }
+
+  cout << "Reclamation stress ..." << endl;
+  stress_reclaim<HazardPointers>( "hazard", 4, 2, 1 << 14 );
+  stress_reclaim<EpochReclaim>( "epoch ", 4, 2, 1 << 14 );
+
+  cout << "SPSC queue tests ..." << endl;
+  SPSCQueue<int, 4> squeue;
+  BoundedSPSCQueue<int, 4> bsqueue;
+  for( i = 0; i < 10; ++i ) {
+    squeue.push( i );
+    if( i < 4 ) {
+      assert( bsqueue.try_push( i ) );
+    }
+  }
+  assert( !bsqueue.try_push( 4 ) );
+  nbulk = squeue.pop_bulk( nis, 6 );
+  k = nbulk;
+  nbulk += squeue.consume_all( [&nis, &k] ( int& value_ ) { nis[k++] = value_; } );
+  assert( nbulk == 10 && !squeue.pop( ni ) );
+  for( i = 0; i < 10; ++i ) {
+    assert( nis[i] == i );
+  }
+  assert( bsqueue.pop( ni ) && ni == 0 && bsqueue.try_push( 4 ) );
+  for( i = 1; bsqueue.pop( ni ); ++i ) {
+    assert( ni == i );
+  }
+  assert( i == 5 );
+  cout << "SPSC benchmark ..." << endl;
+  bench_producers<IntQueue>( "MPSC        ", 1, 1 << 18 );
+  bench_producers<BoundedSPSCQueue<int, 1024>>( "bounded SPSC", 1, 1 << 18 );
+  bench_producers<SPSCQueue<int>>( "SPSC        ", 1, 1 << 18 );
+
+  cout << "Priority queue tests ..." << endl;
+  PriorityMPSCIntrQueue<IntNode, 3, 2> ipqueue;
+  ipqueue.push( ins[0] );
+  ipqueue.push( ins[1], 1 );
+  for( i = 2; i < 7; ++i ) {
+    ipqueue.push( ins[i], 2 );
+  }
+  // two urgent, then one turn for the lanes below, which take it in turns
+  const int expected[] = { 2, 3, 1, 4, 5, 0, 6 };
+  for( i = 0; ( pi = ipqueue.pop() ) != nullptr; ++i ) {
+    assert( pi == &ins[expected[i]] );
+    cout << static_cast<char>( pi->get_value() );
+  }
+  assert( i == 7 );
+  PriorityMPSCIntrQueue<IntNode, 3, 2>::link( ins[7], ins[8] );
+  ipqueue.push_chain( ins[7], ins[8], 1 );
+  assert( ipqueue.pop() == &ins[7] && ipqueue.pop() == &ins[8] && !ipqueue.pop() );
+  PriorityMPSCQueue<int, 2> pqueue;
+  pqueue.push( 1 );
+  pqueue.push( 2, 1 );
+  assert( pqueue.pop( ni ) && ni == 2 && pqueue.waiting_pop( ni ) && ni == 1 && !pqueue.pop( ni ) );
+  cout << endl;
+
+  cout << "Segmented queue tests ..." << endl;
+  SegmentedMPSCQueue<int, 4> sgqueue;
+  for( i = 0; i < 10; ++i ) {
+    sgqueue.push( i );
+  }
+  assert( sgqueue.pop( ni ) && ni == 0 && sgqueue.waiting_pop( ni ) && ni == 1 );
+  nbulk = sgqueue.pop_bulk( nis, 3 );
+  k = nbulk;
+  nbulk += sgqueue.consume_all( [&nis, &k] ( int& value_ ) { nis[k++] = value_; } );
+  assert( nbulk == 8 && !sgqueue.pop( ni ) && !sgqueue.waiting_pop( ni ) );
+  for( i = 0; i < 8; ++i ) {
+    assert( nis[i] == i + 2 );
+  }
+  {
+    const int nthr = 4, per_thread = 1 << 14;
+    std::vector<std::thread> producers;
+    for( int t = 0; t < nthr; ++t ) {
+      producers.emplace_back( [&sgqueue, t, per_thread] () {
+                                for( int j = 0; j < per_thread; ++j ) {
+                                  sgqueue.push( ( t << 20 ) | j );
+                                }
+                              } );
+    }
+    int nexts[nthr] = { 0 };
+    for( int n = 0; n < nthr * per_thread; ) {
+      if( sgqueue.waiting_pop( ni ) ) {
+        assert( ( ni & 0xfffff ) == nexts[ni >> 20]++ ); // FIFO per producer
+        ++n;
+      } else {
+        std::this_thread::yield();
+      }
+    }
+    for( auto& producer : producers ) {
+      producer.join();
+    }
+    assert( !sgqueue.pop( ni ) );
+  }
+  cout << "Segmented queue benchmark ..." << endl;
+  for( int nthr = 1; nthr <= 16; nthr *= 4 ) {
+    bench_producers<IntQueue>( "linked   ", nthr, 1 << 18 );
+    bench_producers<SegmentedMPSCQueue<int>>( "segmented", nthr, 1 << 18 );
+  }
+  bench_drain<IntQueue>( "linked   ", 1 << 20 );
+  bench_drain<SegmentedMPSCQueue<int>>( "segmented", 1 << 20 );
+
+  cout << "Sharded queue tests ..." << endl;
+  ShardedMPSCIntrQueue<IntNode, 4> ishqueue;
+  ShardedMPSCQueue<int, 4> shqueue;
+  for( i = 0; i < 3; ++i ) {
+    ishqueue.push( ins[i] );
+    shqueue.push( i );
+  }
+  assert( ishqueue.waiting_pop() == &ins[0] );
+  nbulk = ishqueue.pop_bulk( pis, 1 );
+  k = nbulk;
+  nbulk += ishqueue.consume_all( [&pis, &k] ( const IntNode& in_ ) { pis[k++] = &in_; } );
+  assert( nbulk == 2 && pis[0] == &ins[1] && pis[1] == &ins[2] && !ishqueue.pop() );
+  ShardedMPSCIntrQueue<IntNode, 4>::link( ins[10], ins[11] );
+  ishqueue.push_chain( ins[10], ins[11] );
+  assert( ishqueue.pop() == &ins[10] && ishqueue.waiting_pop() == &ins[11] && !ishqueue.pop() );
+  assert( shqueue.pop( ni ) && ni == 0 && shqueue.waiting_pop( ni ) && ni == 1 );
+  assert( shqueue.consume_all( [] ( int& value_ ) { assert( value_ == 2 ); } ) == 1 );
+  assert( !shqueue.pop( ni ) && !shqueue.waiting_pop( ni ) );
+  {
+    // more producers than shards: FIFO per producer, nothing lost
+    const int nthr = 8, per_thread = 1 << 13;
+    std::vector<std::thread> producers;
+    for( int t = 0; t < nthr; ++t ) {
+      producers.emplace_back( [&shqueue, t, per_thread] () {
+                                for( int j = 0; j < per_thread; ++j ) {
+                                  shqueue.push( ( t << 20 ) | j );
+                                }
+                              } );
+    }
+    int nexts[nthr] = { 0 };
+    for( int n = 0; n < nthr * per_thread; ) {
+      if( shqueue.waiting_pop( ni ) ) {
+        assert( ( ni & 0xfffff ) == nexts[ni >> 20]++ );
+        ++n;
+      } else {
+        std::this_thread::yield();
+      }
+    }
+    for( auto& producer : producers ) {
+      producer.join();
+    }
+    assert( !shqueue.pop( ni ) );
+  }
+  cout << "Adaptive spin tests ..." << endl;
+  {
+    AdaptiveSpin<100000, 400000> spin( true );
+    assert( !spin.spin( [] () { return true; } ) ); // no window yet
+    spin.parked();                                   // woken at once: spinning would have caught it
+    assert( spin.window_ns() == 100000 );
+    for( std::uint32_t window = 200000; window <= 400000; window *= 2 ) {
+      assert( !spin.spin( [] () { return false; } ) );
+      spin.parked();
+      assert( spin.window_ns() == window );
+    }
+    assert( spin.spin( [] () { return true; } ) );
+    assert( !spin.spin( [] () { return false; } ) );
+    std::this_thread::sleep_for( std::chrono::milliseconds( 2 ) );
+    spin.parked();                                   // too long to spin for
+    assert( spin.window_ns() == 200000 && spin.spins() == 1 && spin.parks() == 4 );
+  }
+  {
+    // wait_for() gives up after the timeout, and not before
+    SpinFutexWait<> wait;
+    const auto t0 = std::chrono::steady_clock::now();
+    assert( !wait.wait_for( [] () { return false; }, std::chrono::milliseconds( 2 ) ) );
+    assert( std::chrono::steady_clock::now() - t0 >= std::chrono::milliseconds( 2 ) );
+    assert( wait.wait_for( [] () { return true; }, std::chrono::milliseconds( 2 ) ) );
+    // a parking wait_for() that finds the element ready keeps it
+    EventfdWait<> parking;
+    int nready = 1;
+    assert( parking.wait_for( [&nready] () { return nready && nready--; }, std::chrono::milliseconds( 2 ) ) );
+    assert( !parking.wait_for( [] () { return false; }, std::chrono::milliseconds( 2 ) ) );
+    EventCount eventcount;
+    assert( !eventcount.commit_wait_for( eventcount.prepare_wait(), std::chrono::microseconds( 100 ) ) );
+    const EventCount::Key key = eventcount.prepare_wait();
+    eventcount.notify();
+    assert( eventcount.commit_wait_for( key, std::chrono::seconds( 10 ) ) );
+  }
+  cout << "Wait strategy benchmark ..." << endl;
+  for( int nthr = 1; nthr <= 2; ++nthr ) {
+    bench_wait<BusySpinWait>( "busy-spin  ", nthr, 1 << 14 );
+    bench_wait<SpinYieldWait<>>( "spin-yield ", nthr, 1 << 14 );
+    bench_wait<SpinFutexWait<>>( "spin-futex ", nthr, 1 << 14 );
+    bench_wait<EventfdWait<>>( "eventfd    ", nthr, 1 << 14 );
+  }
+
+  cout << "Chase-Lev deque tests ..." << endl;
+  {
+    ChaseLevDeque<int> cldeque( 2 );
+    cldeque.push( 1 );
+    cldeque.push( 2 );
+    cldeque.push( 3 ); // grows
+    assert( cldeque.pop( ni ) && ni == 3 );
+    assert( cldeque.steal( ni ) && ni == 1 );
+    assert( cldeque.pop( ni ) && ni == 2 && !cldeque.pop( ni ) && !cldeque.steal( ni ) );
+    constexpr int NVAL = 1 << 16;
+    std::vector<std::atomic<int>> seen( NVAL );
+    std::atomic<bool> done( false );
+    std::vector<std::thread> thieves;
+    for( int t = 0; t < 3; ++t ) {
+      thieves.emplace_back( [&cldeque, &seen, &done] () {
+        int value;
+        while( !done.load( std::memory_order_acquire ) || !cldeque.is_empty() ) {
+          if( cldeque.steal( value ) ) {
+            seen[value].fetch_add( 1, std::memory_order_relaxed );
+          }
+        }
+      } );
+    }
+    for( int j = 0; j < NVAL; ++j ) {
+      cldeque.push( j );
+      if( j % 3 == 0 && cldeque.pop( ni ) ) {
+        seen[ni].fetch_add( 1, std::memory_order_relaxed );
+      }
+    }
+    done.store( true, std::memory_order_release );
+    while( cldeque.pop( ni ) ) {
+      seen[ni].fetch_add( 1, std::memory_order_relaxed );
+    }
+    for( auto& thief : thieves ) {
+      thief.join();
+    }
+    for( int j = 0; j < NVAL; ++j ) {
+      assert( seen[j].load() == 1 );
+    }
+  }
+
+  cout << "Timer wheel tests ..." << endl;
+  {
+    // simulated time in 1 us ticks, from a level 0 slot to beyond the top level
+    const std::uint64_t tick = 1000;
+    TimerWheel wheel( tick );
+    detail::TimerPool pool;
+    const std::uint64_t t0 = TimerWheel::now_ns();
+    const std::uint64_t ticks[] = { 0, 5, 63, 64, 65, 100, 4095, 4096, 4097, 262143, 262145,
+                                    5000000, 16777215, 16777216, 40000000 };
+    const std::size_t ntimers = sizeof( ticks ) / sizeof( ticks[0] );
+    std::vector<detail::TimerNode*> nodes;
+    for( std::size_t j = 0; j < ntimers; ++j ) {
+      nodes.push_back( pool.allocate( Func(), t0 + ticks[j] * tick, 0, pool ) );
+      wheel.add( *nodes.back() );
+    }
+    detail::TimerNode* removed = pool.allocate( Func(), t0 + 70 * tick, 0, pool );
+    wheel.add( *removed );
+    wheel.remove( *removed );
+    pool.deallocate( removed );
+    assert( wheel.size() == ntimers );
+    std::size_t nfired = 0;
+    std::uint64_t now = 0;
+    auto fire = [&nfired, &now, &nodes, &pool] ( detail::TimerNode& node_ ) {
+      assert( node_.deadline_ns <= now && &node_ == nodes[nfired] );
+      ++nfired;
+      pool.deallocate( &node_ );
+    };
+    for( std::size_t j = 0; j < ntimers; ++j ) {
+      const std::uint64_t deadline = t0 + ticks[j] * tick;
+      now = deadline - 1;
+      wheel.advance( now, fire );
+      assert( nfired == j );
+      assert( wheel.timeout_ns( now ) > 0 && wheel.timeout_ns( now ) <= std::int64_t( 2 * tick ) );
+      now = deadline + tick;
+      wheel.advance( now, fire ); // on the tick after, at the latest
+      assert( nfired == j + 1 );
+    }
+    assert( wheel.empty() && wheel.timeout_ns( now ) == -1 );
+    // one jump over all of them runs them in order
+    nodes.clear();
+    nfired = 0;
+    for( std::size_t j = ntimers; j-- > 0; ) {
+      nodes.insert( nodes.begin(), pool.allocate( Func(), now + ticks[j] * tick, 0, pool ) );
+      wheel.add( *nodes.front() );
+    }
+    now += ticks[ntimers - 1] * tick + tick;
+    wheel.advance( now, fire );
+    assert( nfired == ntimers && wheel.empty() );
+  }
+
+  cout << "Shared memory queue tests ..." << endl;
+  {
+    ShmMPSCQueue<int, 2> smqueue;
+    assert( smqueue.try_push( 1 ) && smqueue.try_push( 2 ) && !smqueue.try_push( 3 ) );
+    assert( smqueue.pop( ni ) && ni == 1 && smqueue.try_push( 3 ) );
+    assert( smqueue.consume_all( [&ni] ( int& value_ ) { ni = value_; } ) == 2 && ni == 3 );
+    assert( !smqueue.waiting_pop( ni ) );
+    const std::string name = "/znl_shmqueue_test_" + std::to_string( ::getpid() );
+    ShmMPSCQueue<int, 2> created( name, ShmMPSCQueue<int, 2>::Create() );
+    ShmMPSCQueue<int, 2> opened( name, ShmMPSCQueue<int, 2>::Open() );
+    opened.push( 7 );
+    assert( created.pop( ni ) && ni == 7 && !created.pop( ni ) );
+  }
+  cout << "Shared memory queue benchmark ..." << endl;
+  for( int nproc = 1; nproc <= 4; nproc *= 2 ) {
+    bench_processes( false, nproc, 1 << 17 );
+    bench_processes( true, nproc, 1 << 17 );
+  }
+
+  cout << "Sharded queue scaling ..." << endl;
+  for( int nthr = 1; nthr <= 64; nthr *= 2 ) {
+    bench_producers<CountedIntQueue>( "single ", nthr, 1 << 17, true );
+    bench_producers<ShardedMPSCQueue<int, 64, CountingIntPool>>( "sharded", nthr, 1 << 17, true );
+  }
 }
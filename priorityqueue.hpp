@@ -0,0 +1,147 @@
+//  Multi-lane priority MPSC intrusive and non-intrusive queues
+//
+//  Copyright (C) 2018 Zoltan N. Leskowsky
+//
+//  Distributed under the Boost Software License, Version 1.0. (See
+//  accompanying file LICENSE_1_0.txt or copy at
+//  http://www.boost.org/LICENSE_1_0.txt)
+
+#ifndef ZNL_PRIORITY_QUEUE_HPP_INCLUDED
+#define ZNL_PRIORITY_QUEUE_HPP_INCLUDED
+
+#include <cstddef>
+#include <utility>
+
+#include "mpscqueue.hpp"
+
+#ifdef BOOST_HAS_PRAGMA_ONCE
+#pragma once
+#endif
+
+
+#if defined(_MSC_VER)
+#endif
+
+
+namespace znl {
+namespace detail {
+
+// Consumer-side lane choice: the highest non-empty lane wins, except that a
+// lane served Quantum times in a row while lower lanes were passed over
+// yields one turn to the lanes below it.
+template<std::size_t Lanes, unsigned Quantum>
+class LaneScheduler
+{
+  static_assert( Lanes > 0, "Lanes must be positive" );
+  static_assert( Quantum > 0, "Quantum must be positive" );
+public:
+  LaneScheduler() {
+    for( std::size_t l = 0; l < Lanes; ++l ) {
+      _streak[l] = 0;
+    }
+  }
+  // try_lane_( l ) pops from lane l if it can.
+  template<typename TryLane>
+  bool next( TryLane&& try_lane_ ) { return next_from( Lanes - 1, try_lane_ ); }
+private:
+  template<typename TryLane>
+  bool next_from( std::size_t top_, TryLane& try_lane_ ) {
+    for( std::size_t l = top_ + 1; l-- > 0; ) {
+      if( l > 0 && _streak[l] >= Quantum ) {
+        _streak[l] = 0;
+        if( next_from( l - 1, try_lane_ ) ) {
+          return true;
+        }
+      }
+      if( try_lane_( l ) ) {
+        ++_streak[l];
+        for( std::size_t m = l + 1; m < Lanes; ++m ) {
+          _streak[m] = 0;
+        }
+        return true;
+      }
+    }
+    return false;
+  }
+private:
+  unsigned _streak[Lanes];
+};
+
+} //namespace detail
+
+// Lanes are numbered by priority: push( val, Lanes - 1 ) is the most urgent,
+// push( val ) the least.
+
+template<class T, std::size_t Lanes, unsigned Quantum = 64, typename Padding = MPSCDefaultPadding>
+class PriorityMPSCIntrQueue
+{
+public:
+  static constexpr std::size_t lanes = Lanes;
+
+  void push( const T& val_, std::size_t priority_ = 0 ) { lane( priority_ ).push( val_ ); }
+  static void link( const T& prev_, const T& next_ ) { MPSCIntrQueue<T, Padding>::link( prev_, next_ ); }
+  void push_chain( const T& first_, const T& last_, std::size_t priority_ = 0 ) {
+    lane( priority_ ).push_chain( first_, last_ );
+  }
+  const T* pop() {
+    const T* val = nullptr;
+    _scheduler.next( [this, &val] ( std::size_t l_ ) {
+                       return ( val = _lanes[l_].pop() ) != nullptr;
+                     } );
+    return val;
+  }
+  template<typename Backoff = detail::SpinYieldBackoff<>>
+  const T* waiting_pop() {
+    const T* val = nullptr;
+    _scheduler.next( [this, &val] ( std::size_t l_ ) {
+                       return ( val = _lanes[l_].template waiting_pop<Backoff>() ) != nullptr;
+                     } );
+    return val;
+  }
+private:
+  MPSCIntrQueue<T, Padding>& lane( std::size_t priority_ ) {
+    return _lanes[priority_ < Lanes ? priority_ : Lanes - 1];
+  }
+private:
+  MPSCIntrQueue<T, Padding>                 _lanes[Lanes];
+  detail::LaneScheduler<Lanes, Quantum>     _scheduler;
+};
+
+template<typename T, std::size_t Lanes, unsigned Quantum = 64,
+         typename Alloc = MPSCNodePool<T>, typename Padding = MPSCDefaultPadding>
+class PriorityMPSCQueue
+{
+public:
+  static constexpr std::size_t lanes = Lanes;
+
+  void push( const T& value_, std::size_t priority_ = 0 ) { lane( priority_ ).push( value_ ); }
+  void push( T&& value_, std::size_t priority_ = 0 ) { lane( priority_ ).push( std::move( value_ ) ); }
+  bool pop( T& value_ ) {
+    return _scheduler.next( [this, &value_] ( std::size_t l_ ) {
+                              return _lanes[l_].pop( value_ );
+                            } );
+  }
+  template<typename Backoff = detail::SpinYieldBackoff<>>
+  bool waiting_pop( T& value_ ) {
+    return _scheduler.next( [this, &value_] ( std::size_t l_ ) {
+                              return _lanes[l_].template waiting_pop<Backoff>( value_ );
+                            } );
+  }
+private:
+  MPSCQueue<T, Alloc, Padding>& lane( std::size_t priority_ ) {
+    return _lanes[priority_ < Lanes ? priority_ : Lanes - 1];
+  }
+private:
+  MPSCQueue<T, Alloc, Padding>              _lanes[Lanes];
+  detail::LaneScheduler<Lanes, Quantum>     _scheduler;
+};
+
+template<class T, std::size_t Lanes, unsigned Quantum, typename Padding>
+constexpr std::size_t PriorityMPSCIntrQueue<T, Lanes, Quantum, Padding>::lanes;
+
+template<typename T, std::size_t Lanes, unsigned Quantum, typename Alloc, typename Padding>
+constexpr std::size_t PriorityMPSCQueue<T, Lanes, Quantum, Alloc, Padding>::lanes;
+
+} //namespace znl
+
+#endif //ZNL_PRIORITY_QUEUE_HPP_INCLUDED
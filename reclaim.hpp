@@ -0,0 +1,346 @@
+//  Deferred reclamation for lock-free structures: hazard pointers (Michael,
+//  Maged M., "Hazard Pointers: Safe Memory Reclamation for Lock-Free Objects",
+//  2004) and epochs (Fraser, Keir, "Practical lock-freedom", 2004)
+//
+//  Copyright (C) 2018 Zoltan N. Leskowsky
+//
+//  Distributed under the Boost Software License, Version 1.0. (See
+//  accompanying file LICENSE_1_0.txt or copy at
+//  http://www.boost.org/LICENSE_1_0.txt)
+
+#ifndef ZNL_RECLAIM_HPP_INCLUDED
+#define ZNL_RECLAIM_HPP_INCLUDED
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "atomiclock.hpp"
+
+#ifdef BOOST_HAS_PRAGMA_ONCE
+#pragma once
+#endif
+
+
+#if defined(_MSC_VER)
+#endif
+
+
+namespace znl {
+
+// Both domains are process-wide and share one interface:
+//
+//   Domain::Guard g;             // registers the thread on first use
+//   p = g.hold( i, p );          // protects p, slot i < Domain::per_thread
+//   Domain::retire( p, deleter ); // deleter( p ) once no guard can hold p
+//   Domain::retire( p );         // delete p
+//   Domain::collect();           // reclaims what it can now
+//
+// A thread's record is taken on first use from a list that only grows and is
+// handed back when the thread exits. Retired pointers are kept per thread and
+// reclaimed in batches; those left when a thread exits are adopted by the
+// next collection in any thread.
+
+typedef void (*Deleter)( void* );
+
+namespace detail {
+
+template<typename T>
+void delete_object( void* p_ )
+{
+  delete static_cast<T*>( p_ );
+}
+
+// Grow-only list of per-thread records, reused once their thread exits.
+template<typename Record>
+class RecordList
+{
+public:
+  static Record* head() { return records().load( std::memory_order_acquire ); }
+  static std::size_t size() { return nrecords().load( std::memory_order_relaxed ); }
+  static Record& acquire() {
+    for( Record* rec = head(); rec; rec = rec->_next ) {
+      bool active = false;
+      if( !rec->_active.load( std::memory_order_relaxed ) &&
+          rec->_active.compare_exchange_strong( active, true, std::memory_order_acq_rel ) ) {
+        return *rec;
+      }
+    }
+    Record* rec = new Record;
+    rec->_active.store( true, std::memory_order_relaxed );
+    rec->_next = records().load( std::memory_order_relaxed );
+    while( !records().compare_exchange_weak( rec->_next, rec,
+                                             std::memory_order_release,
+                                             std::memory_order_relaxed ) ) ;
+    ++nrecords();
+    return *rec;
+  }
+  static void release( Record& rec_ ) { rec_._active.store( false, std::memory_order_release ); }
+private:
+  static std::atomic<Record*>& records() {
+    static std::atomic<Record*> head( nullptr );
+    return head;
+  }
+  static std::atomic<std::size_t>& nrecords() {
+    static std::atomic<std::size_t> n( 0 );
+    return n;
+  }
+};
+
+// Retired pointers left by exited threads.
+template<typename Retired, typename Domain>
+class Orphans
+{
+public:
+  static void add( const std::vector<Retired>& retired_ ) {
+    AtomicLockGuard lk( lock() );
+    list().insert( list().end(), retired_.begin(), retired_.end() );
+  }
+  static void adopt( std::vector<Retired>& retired_ ) {
+    AtomicLockGuard lk( lock() );
+    retired_.insert( retired_.end(), list().begin(), list().end() );
+    list().clear();
+  }
+private:
+  static std::vector<Retired>& list() {
+    static std::vector<Retired> retired;
+    return retired;
+  }
+  static std::atomic_flag& lock() {
+    static std::atomic_flag flag = ATOMIC_FLAG_INIT;
+    return flag;
+  }
+};
+
+} //namespace detail
+
+// Hazard pointers: a guard publishes up to per_thread pointers it is about
+// to dereference; the caller re-checks that each is still reachable after
+// hold(). A retired pointer is reclaimed once no record holds it. Memory
+// still waiting is bounded, but every hold() is a seq_cst store.
+
+class HazardPointers
+{
+  struct Record;
+  struct Local;
+public:
+  static constexpr int per_thread = 2;
+
+  class Guard
+  {
+  public:
+    Guard() : _record( local()._record ) {}
+    Guard( const Guard& ) = delete;
+    Guard& operator=( const Guard& ) = delete;
+    ~Guard() { clear(); }
+    template<typename T>
+    T* hold( int i_, T* p_ ) {
+      _record._hazards[i_].store( p_, std::memory_order_seq_cst );
+      return p_;
+    }
+    void clear() {
+      for( int i = 0; i < per_thread; ++i ) {
+        _record._hazards[i].store( nullptr, std::memory_order_release );
+      }
+    }
+  private:
+    Record& _record;
+  };
+
+  static void retire( void* p_, Deleter deleter_ ) {
+    Local& loc = local();
+    loc._retired.push_back( Retired( p_, deleter_ ) );
+    if( loc._retired.size() >= threshold() ) {
+      scan( loc._retired );
+    }
+  }
+  template<typename T>
+  static void retire( T* p_ ) { retire( p_, &detail::delete_object<T> ); }
+  static void collect() { scan( local()._retired ); }
+
+private:
+  friend class Guard;
+  struct Record {
+    Record() : _active( false ), _next( nullptr ) {
+      for( int i = 0; i < per_thread; ++i ) {
+        _hazards[i].store( nullptr, std::memory_order_relaxed );
+      }
+    }
+    std::atomic<const void*> _hazards[per_thread];
+    std::atomic<bool>        _active;
+    Record*                  _next;
+  };
+  typedef detail::RecordList<Record> Records;
+  typedef std::pair<void*, Deleter> Retired;
+  typedef detail::Orphans<Retired, HazardPointers> Orphans;
+
+  struct Local {
+    Local() : _record( Records::acquire() ) {}
+    ~Local() {
+      for( int i = 0; i < per_thread; ++i ) {
+        _record._hazards[i].store( nullptr, std::memory_order_release );
+      }
+      scan( _retired );
+      if( !_retired.empty() ) {
+        Orphans::add( _retired );
+      }
+      Records::release( _record );
+    }
+    Record&              _record;
+    std::vector<Retired> _retired;
+  };
+
+  static Local& local() {
+    static thread_local Local loc;
+    return loc;
+  }
+  static std::size_t threshold() { return 2 * per_thread * Records::size() + 64; }
+  static void scan( std::vector<Retired>& retired_ ) {
+    Orphans::adopt( retired_ );
+    std::atomic_thread_fence( std::memory_order_seq_cst );
+    std::vector<const void*> hazards;
+    for( Record* rec = Records::head(); rec; rec = rec->_next ) {
+      for( int i = 0; i < per_thread; ++i ) {
+        if( const void* p = rec->_hazards[i].load( std::memory_order_seq_cst ) ) {
+          hazards.push_back( p );
+        }
+      }
+    }
+    std::sort( hazards.begin(), hazards.end() );
+    std::size_t kept = 0;
+    for( std::size_t i = 0; i < retired_.size(); ++i ) {
+      if( std::binary_search( hazards.begin(), hazards.end(), retired_[i].first ) ) {
+        retired_[kept++] = retired_[i];
+      } else {
+        retired_[i].second( retired_[i].first );
+      }
+    }
+    retired_.erase( retired_.begin() + kept, retired_.end() );
+  }
+};
+
+// Epochs: a guard pins the global epoch for its whole scope, so hold() is
+// free and any number of pointers may be used. A pointer retired in epoch e
+// is reclaimed once the epoch reaches e + 2, which needs every pinned thread
+// to have seen e + 1; one stalled guard therefore holds back all reclamation.
+// Guards nest.
+
+class EpochReclaim
+{
+  struct Record;
+  struct Local;
+public:
+  static constexpr int per_thread = 2;
+
+  class Guard
+  {
+  public:
+    Guard() : _local( local() ) { _local.enter(); }
+    Guard( const Guard& ) = delete;
+    Guard& operator=( const Guard& ) = delete;
+    ~Guard() { _local.leave(); }
+    template<typename T>
+    T* hold( int, T* p_ ) { return p_; }
+    void clear() {}
+  private:
+    Local& _local;
+  };
+
+  static void retire( void* p_, Deleter deleter_ ) {
+    Local& loc = local();
+    std::atomic_thread_fence( std::memory_order_seq_cst );
+    loc._retired.push_back( Retired( p_, deleter_, epoch().load( std::memory_order_seq_cst ) ) );
+    if( loc._retired.size() >= threshold ) {
+      reclaim( loc._retired );
+    }
+  }
+  template<typename T>
+  static void retire( T* p_ ) { retire( p_, &detail::delete_object<T> ); }
+  static void collect() { reclaim( local()._retired ); }
+
+private:
+  friend class Guard;
+  static constexpr std::size_t threshold = 64;
+
+  struct Record {
+    Record() : _pinned( 0 ), _active( false ), _next( nullptr ) {}
+    std::atomic<std::uint64_t> _pinned; // epoch << 1 | 1 inside a guard, else 0
+    std::atomic<bool>          _active;
+    Record*                    _next;
+  };
+  typedef detail::RecordList<Record> Records;
+  struct Retired {
+    Retired( void* p_, Deleter deleter_, std::uint64_t epoch_ )
+      : _p( p_ ), _deleter( deleter_ ), _epoch( epoch_ ) {}
+    void*         _p;
+    Deleter       _deleter;
+    std::uint64_t _epoch;
+  };
+  typedef detail::Orphans<Retired, EpochReclaim> Orphans;
+
+  struct Local {
+    Local() : _record( Records::acquire() ), _nest( 0 ) {}
+    ~Local() {
+      reclaim( _retired );
+      if( !_retired.empty() ) {
+        Orphans::add( _retired );
+      }
+      Records::release( _record );
+    }
+    void enter() {
+      if( _nest++ == 0 ) {
+        const std::uint64_t e = epoch().load( std::memory_order_relaxed );
+        _record._pinned.store( e << 1 | 1, std::memory_order_relaxed );
+        std::atomic_thread_fence( std::memory_order_seq_cst );
+      }
+    }
+    void leave() {
+      if( --_nest == 0 ) {
+        _record._pinned.store( 0, std::memory_order_release );
+      }
+    }
+    Record&              _record;
+    unsigned             _nest;
+    std::vector<Retired> _retired;
+  };
+
+  static Local& local() {
+    static thread_local Local loc;
+    return loc;
+  }
+  static std::atomic<std::uint64_t>& epoch() {
+    static std::atomic<std::uint64_t> e( 0 );
+    return e;
+  }
+  static void try_advance() {
+    std::atomic_thread_fence( std::memory_order_seq_cst );
+    std::uint64_t e = epoch().load( std::memory_order_seq_cst );
+    for( Record* rec = Records::head(); rec; rec = rec->_next ) {
+      const std::uint64_t pinned = rec->_pinned.load( std::memory_order_seq_cst );
+      if( ( pinned & 1 ) && ( pinned >> 1 ) != e ) {
+        return;
+      }
+    }
+    epoch().compare_exchange_strong( e, e + 1, std::memory_order_acq_rel );
+  }
+  static void reclaim( std::vector<Retired>& retired_ ) {
+    Orphans::adopt( retired_ );
+    try_advance();
+    const std::uint64_t e = epoch().load( std::memory_order_acquire );
+    std::size_t kept = 0;
+    for( std::size_t i = 0; i < retired_.size(); ++i ) {
+      if( retired_[i]._epoch + 2 > e ) {
+        retired_[kept++] = retired_[i];
+      } else {
+        retired_[i]._deleter( retired_[i]._p );
+      }
+    }
+    retired_.erase( retired_.begin() + kept, retired_.end() );
+  }
+};
+
+} //namespace znl
+
+#endif //ZNL_RECLAIM_HPP_INCLUDED
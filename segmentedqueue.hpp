@@ -0,0 +1,254 @@
+//  Lock-free unbounded MPSC queue of array blocks
+//
+//  Copyright (C) 2018 Zoltan N. Leskowsky
+//
+//  Distributed under the Boost Software License, Version 1.0. (See
+//  accompanying file LICENSE_1_0.txt or copy at
+//  http://www.boost.org/LICENSE_1_0.txt)
+
+#ifndef ZNL_SEGMENTED_QUEUE_HPP_INCLUDED
+#define ZNL_SEGMENTED_QUEUE_HPP_INCLUDED
+
+#include <atomic>
+#include <cstddef>
+#include <limits>
+#include <memory>
+#include <new>
+#include <utility>
+
+#include "mpscqueue.hpp"
+
+#ifdef BOOST_HAS_PRAGMA_ONCE
+#pragma once
+#endif
+
+
+#if defined(_MSC_VER)
+#endif
+
+
+namespace znl {
+
+// Unbounded queue of linked blocks of BlockSize slots. Producers claim a slot
+// in the tail block with one fetch_add and publish it with a ready flag; the
+// producer that overflows the tail block links the next one, already holding
+// its value. The consumer reads slots in order as from a ring, and only
+// follows a link once per block.
+//
+// Drained blocks are recycled through a free stack and only deleted with the
+// queue. A producer pins the tail block before claiming in it and re-checks
+// that it is still the tail, so the consumer recycles a block only once it is
+// no longer the tail and no producer pins it.
+//
+// push()/pop() match MPSCQueue; T must be default-constructible.
+
+template<typename T, std::size_t BlockSize = 64, typename Padding = MPSCDefaultPadding>
+class SegmentedMPSCQueue
+{
+  static_assert( BlockSize > 0, "BlockSize must be positive" );
+  struct Slot {
+    std::atomic<bool> _ready;
+    T                 _value;
+  };
+  struct Block {
+    Block() : _claimed( 0 ), _refs( 0 ), _next( nullptr ),
+      _free_next( nullptr ), _all_next( nullptr ) {
+      for( std::size_t i = 0; i < BlockSize; ++i ) {
+        _slots[i]._ready.store( false, std::memory_order_relaxed );
+      }
+    }
+    std::atomic<std::size_t> _claimed;
+    std::atomic<std::size_t> _refs;
+    std::atomic<Block*>      _next;
+    Block*                   _free_next; // free stack or consumer's drained list
+    Block*                   _all_next;
+    void*                    _raw; // as allocated
+    alignas( Padding::alignment ) Slot _slots[BlockSize];
+  };
+public:
+  SegmentedMPSCQueue() : _tail( nullptr ), _free( nullptr ), _all( nullptr ),
+    _head( nullptr ), _read( 0 ), _drained( nullptr ) {
+    _head = new_block();
+    _tail.store( _head, std::memory_order_relaxed );
+  }
+  SegmentedMPSCQueue( const SegmentedMPSCQueue& ) = delete;
+  SegmentedMPSCQueue& operator=( const SegmentedMPSCQueue& ) = delete;
+  ~SegmentedMPSCQueue() {
+    Block* next;
+    for( Block* block = _all.load( std::memory_order_relaxed ); block; block = next ) {
+      next = block->_all_next;
+      void* raw = block->_raw;
+      block->~Block();
+      ::operator delete( raw );
+    }
+  }
+  void push( const T& value_ ) { write( value_ ); }
+  void push( T&& value_ ) { write( std::move( value_ ) ); }
+  bool pop( T& value_ ) {
+    return consume( [&value_] ( T& v_ ) { value_ = std::move( v_ ); }, 1 ) != 0;
+  }
+  template<typename Backoff = detail::SpinYieldBackoff<>>
+  bool waiting_pop( T& value_ ) {
+    Backoff backoff;
+    while( !pop( value_ ) ) {
+      if( is_empty() ) {
+        return false;
+      }
+      backoff();
+    }
+    return true;
+  }
+  template<typename OutputIt>
+  std::size_t pop_bulk( OutputIt out_, std::size_t max_ ) {
+    return consume( [&out_] ( T& value_ ) { *out_++ = std::move( value_ ); }, max_ );
+  }
+  template<typename F>
+  std::size_t consume_all( F f_ ) {
+    return consume( f_, std::numeric_limits<std::size_t>::max() );
+  }
+
+private:
+  template<typename U>
+  void write( U&& value_ ) {
+    for( ;; ) {
+      Block* tail = pin_tail();
+      const std::size_t i = tail->_claimed.fetch_add( 1, std::memory_order_relaxed );
+      if( i < BlockSize ) {
+        publish( tail->_slots[i], std::forward<U>( value_ ) );
+        unpin( tail );
+        return;
+      }
+      Block* next = tail->_next.load( std::memory_order_acquire );
+      if( !next ) {
+        Block* block = acquire_block();
+        publish( block->_slots[0], std::forward<U>( value_ ) );
+        if( tail->_next.compare_exchange_strong( next, block, std::memory_order_acq_rel ) ) {
+          advance_tail( tail, block );
+          unpin( tail );
+          return;
+        }
+        // lost to another producer; block was never visible
+        take_back( value_, block->_slots[0]._value );
+        block->_slots[0]._ready.store( false, std::memory_order_relaxed );
+        release_block( block, block );
+      }
+      advance_tail( tail, next );
+      unpin( tail );
+    }
+  }
+  void advance_tail( Block* tail_, Block* next_ ) {
+    _tail.compare_exchange_strong( tail_, next_, std::memory_order_release,
+                                   std::memory_order_relaxed );
+  }
+  template<typename U>
+  static void publish( Slot& slot_, U&& value_ ) {
+    slot_._value = std::forward<U>( value_ );
+    slot_._ready.store( true, std::memory_order_release );
+  }
+  static void take_back( const T&, T& ) {}
+  static void take_back( T& value_, T& from_ ) { value_ = std::move( from_ ); }
+  Block* pin_tail() {
+    for( ;; ) {
+      Block* tail = _tail.load( std::memory_order_acquire );
+      tail->_refs.fetch_add( 1, std::memory_order_seq_cst );
+      if( tail == _tail.load( std::memory_order_seq_cst ) ) {
+        return tail;
+      }
+      unpin( tail );
+    }
+  }
+  static void unpin( Block* block_ ) { block_->_refs.fetch_sub( 1, std::memory_order_release ); }
+  Block* acquire_block() {
+    Block* block = _free.exchange( nullptr, std::memory_order_acquire );
+    if( !block ) {
+      block = new_block();
+    } else if( Block* rest = block->_free_next ) {
+      Block* last = rest;
+      while( last->_free_next ) {
+        last = last->_free_next;
+      }
+      release_block( rest, last );
+    }
+    block->_next.store( nullptr, std::memory_order_relaxed );
+    block->_claimed.store( 1, std::memory_order_relaxed );
+    return block;
+  }
+  // Pushes the chain first_ .. last_ onto the free stack; only producers
+  // pop, and they take the whole stack, so there is no ABA problem.
+  void release_block( Block* first_, Block* last_ ) {
+    last_->_free_next = _free.load( std::memory_order_relaxed );
+    while( !_free.compare_exchange_weak( last_->_free_next, first_,
+                                         std::memory_order_release,
+                                         std::memory_order_relaxed ) ) ;
+  }
+  Block* new_block() {
+    // operator new is not alignment-aware before C++17
+    void* raw = ::operator new( sizeof( Block ) + alignof( Block ) - 1 );
+    std::size_t space = sizeof( Block ) + alignof( Block ) - 1;
+    void* aligned = raw;
+    Block* block = new ( std::align( alignof( Block ), sizeof( Block ), aligned, space ) ) Block;
+    block->_raw = raw;
+    block->_all_next = _all.load( std::memory_order_relaxed );
+    while( !_all.compare_exchange_weak( block->_all_next, block,
+                                        std::memory_order_release,
+                                        std::memory_order_relaxed ) ) ;
+    return block;
+  }
+  template<typename F>
+  std::size_t consume( F&& f_, std::size_t max_ ) {
+    std::size_t n = 0;
+    while( n < max_ ) {
+      if( _read == BlockSize ) {
+        Block* next = _head->_next.load( std::memory_order_acquire );
+        if( !next ) {
+          break; // empty, or the next block is being linked
+        }
+        _head->_free_next = _drained;
+        _drained = _head;
+        _head = next;
+        _read = 0;
+        recycle_drained();
+        continue;
+      }
+      Slot& slot = _head->_slots[_read];
+      if( !slot._ready.load( std::memory_order_acquire ) ) {
+        break; // empty, or a push in process
+      }
+      f_( slot._value );
+      slot._ready.store( false, std::memory_order_relaxed );
+      ++_read;
+      ++n;
+    }
+    return n;
+  }
+  void recycle_drained() {
+    Block** link = &_drained;
+    while( Block* block = *link ) {
+      if( block != _tail.load( std::memory_order_seq_cst ) &&
+          block->_refs.load( std::memory_order_seq_cst ) == 0 ) {
+        *link = block->_free_next;
+        release_block( block, block );
+      } else {
+        link = &block->_free_next;
+      }
+    }
+  }
+  bool is_empty() const {
+    return _head->_claimed.load( std::memory_order_acquire ) <= _read &&
+           !_head->_next.load( std::memory_order_acquire );
+  }
+
+private:
+  // producers
+  alignas( Padding::alignment ) std::atomic<Block*> _tail;
+  std::atomic<Block*>      _free;
+  std::atomic<Block*>      _all;
+  // consumer
+  alignas( Padding::alignment ) Block* _head;
+  std::size_t _read;
+  Block*      _drained; // consumed, waiting for pins to go
+};
+
+} //namespace znl
+
+#endif //ZNL_SEGMENTED_QUEUE_HPP_INCLUDED
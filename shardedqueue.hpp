@@ -0,0 +1,269 @@
+//  MPSC intrusive and non-intrusive queues sharded by producer thread
+//
+//  Copyright (C) 2018 Zoltan N. Leskowsky
+//
+//  Distributed under the Boost Software License, Version 1.0. (See
+//  accompanying file LICENSE_1_0.txt or copy at
+//  http://www.boost.org/LICENSE_1_0.txt)
+
+#ifndef ZNL_SHARDED_QUEUE_HPP_INCLUDED
+#define ZNL_SHARDED_QUEUE_HPP_INCLUDED
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+
+#include "mpscqueue.hpp"
+
+#ifdef BOOST_HAS_PRAGMA_ONCE
+#pragma once
+#endif
+
+
+#if defined(_MSC_VER)
+#endif
+
+
+namespace znl {
+namespace detail {
+
+// Small dense id per thread, in order of first use.
+inline unsigned thread_index()
+{
+  static std::atomic<unsigned> next( 0 );
+  static thread_local unsigned index = next++;
+  return index;
+}
+
+inline std::size_t lowest_bit( std::uint64_t bits_ )
+{
+#if defined(__GNUC__)
+  return static_cast<std::size_t>( __builtin_ctzll( bits_ ) );
+#else
+  std::size_t i = 0;
+  for( ; !( bits_ & 1 ); bits_ >>= 1 ) {
+    ++i;
+  }
+  return i;
+#endif
+}
+
+// Maps producer threads to Shards sub-queues and tracks which may hold
+// values. A producer sets its shard's bit after a push, reading the bitmap
+// first so that a busy shard costs no RMW; the consumer clears a bit only
+// when the shard is empty with no push in process, and re-checks the shard
+// after clearing. The fences order each side's queue access against its
+// bitmap access, so either the producer sees the bit cleared and sets it, or
+// the consumer sees the push and restores it.
+//
+// The consumer visits shards round-robin from a cursor, one value per shard
+// per turn.
+template<std::size_t Shards>
+class ShardMap
+{
+  static_assert( Shards > 0 && Shards <= 64, "Shards must be in 1..64" );
+public:
+  ShardMap() : _nonempty( 0 ), _cursor( 0 ) {}
+  static std::size_t shard() { return thread_index() % Shards; }
+  void mark( std::size_t s_ ) {
+    const std::uint64_t m = bit( s_ );
+    std::atomic_thread_fence( std::memory_order_seq_cst );
+    if( !( _nonempty.load( std::memory_order_relaxed ) & m ) ) {
+      _nonempty.fetch_or( m, std::memory_order_release );
+    }
+  }
+  bool any() const { return _nonempty.load( std::memory_order_acquire ) != 0; }
+  // try_shard_( s ) pops from shard s if it can; is_empty_( s ) is true
+  // when s is empty with no push in process.
+  template<typename TryShard, typename IsEmpty>
+  bool next( TryShard&& try_shard_, IsEmpty&& is_empty_ ) {
+    std::uint64_t bits = _nonempty.load( std::memory_order_acquire );
+    while( bits ) {
+      const std::size_t s = pick( bits );
+      if( try_shard_( s ) ) {
+        _cursor = s + 1 == Shards ? 0 : s + 1;
+        return true;
+      }
+      settle( s, is_empty_ );
+      bits &= ~bit( s );
+    }
+    return false;
+  }
+  // drain_( s ) takes what it can from shard s; returns the sum.
+  template<typename Drain, typename IsEmpty>
+  std::size_t drain( Drain&& drain_, IsEmpty&& is_empty_ ) {
+    std::uint64_t bits = _nonempty.load( std::memory_order_acquire );
+    std::size_t n = 0;
+    while( bits ) {
+      const std::size_t s = pick( bits );
+      n += drain_( s );
+      settle( s, is_empty_ );
+      bits &= ~bit( s );
+    }
+    return n;
+  }
+private:
+  static std::uint64_t bit( std::size_t s_ ) { return std::uint64_t( 1 ) << s_; }
+  std::size_t pick( std::uint64_t bits_ ) const {
+    const std::uint64_t ahead = bits_ & ( ~std::uint64_t( 0 ) << _cursor );
+    return lowest_bit( ahead ? ahead : bits_ );
+  }
+  template<typename IsEmpty>
+  void settle( std::size_t s_, IsEmpty& is_empty_ ) {
+    if( !is_empty_( s_ ) ) {
+      return;
+    }
+    const std::uint64_t m = bit( s_ );
+    _nonempty.fetch_and( ~m, std::memory_order_seq_cst );
+    std::atomic_thread_fence( std::memory_order_seq_cst );
+    if( !is_empty_( s_ ) ) {
+      _nonempty.fetch_or( m, std::memory_order_relaxed );
+    }
+  }
+private:
+  std::atomic<std::uint64_t> _nonempty;
+  std::size_t                _cursor; // consumer-owned
+};
+
+} //namespace detail
+
+// Queues with the MPSCQueue and MPSCIntrQueue interfaces that give each
+// producer thread, or with more threads than Shards each group of threads,
+// its own sub-queue, so producers no longer contend on one _last. Values from
+// one producer keep their order; values from different producers are
+// interleaved round-robin.
+
+template<typename T, std::size_t Shards = 16,
+         typename Alloc = MPSCNodePool<T>, typename Padding = MPSCDefaultPadding>
+class ShardedMPSCQueue
+{
+  struct Shard : MPSCQueue<T, Alloc, Padding> {
+    using MPSCQueueBase<Padding>::is_empty;
+  };
+public:
+  static constexpr std::size_t shards = Shards;
+
+  void push( const T& value_ ) {
+    const std::size_t s = _map.shard();
+    _shards[s].push( value_ );
+    _map.mark( s );
+  }
+  void push( T&& value_ ) {
+    const std::size_t s = _map.shard();
+    _shards[s].push( std::move( value_ ) );
+    _map.mark( s );
+  }
+  bool pop( T& value_ ) {
+    return _map.next( [this, &value_] ( std::size_t s_ ) { return _shards[s_].pop( value_ ); },
+                      is_empty() );
+  }
+  template<typename Backoff = detail::SpinYieldBackoff<>>
+  bool waiting_pop( T& value_ ) {
+    Backoff backoff;
+    while( !pop( value_ ) ) {
+      if( !_map.any() ) {
+        return false;
+      }
+      backoff();
+    }
+    return true;
+  }
+  template<typename OutputIt>
+  std::size_t pop_bulk( OutputIt out_, std::size_t max_ ) {
+    std::size_t n = 0;
+    T value;
+    while( n < max_ && pop( value ) ) {
+      *out_++ = std::move( value );
+      ++n;
+    }
+    return n;
+  }
+  template<typename F>
+  std::size_t consume_all( F f_ ) {
+    return _map.drain( [this, &f_] ( std::size_t s_ ) {
+                         return _shards[s_].consume_all( [&f_] ( T& value_ ) { f_( value_ ); } );
+                       }, is_empty() );
+  }
+private:
+  struct IsEmpty {
+    bool operator()( std::size_t s_ ) const { return _shards[s_].is_empty(); }
+    const Shard* _shards;
+  };
+  IsEmpty is_empty() const { return IsEmpty{ _shards }; }
+private:
+  Shard                      _shards[Shards];
+  alignas( Padding::alignment ) detail::ShardMap<Shards> _map;
+};
+
+template<class T, std::size_t Shards = 16, typename Padding = MPSCDefaultPadding>
+class ShardedMPSCIntrQueue
+{
+  struct Shard : MPSCIntrQueue<T, Padding> {
+    using MPSCQueueBase<Padding>::is_empty;
+  };
+public:
+  static constexpr std::size_t shards = Shards;
+
+  void push( const T& val_ ) {
+    const std::size_t s = _map.shard();
+    _shards[s].push( val_ );
+    _map.mark( s );
+  }
+  static void link( const T& prev_, const T& next_ ) { MPSCIntrQueue<T, Padding>::link( prev_, next_ ); }
+  void push_chain( const T& first_, const T& last_ ) {
+    const std::size_t s = _map.shard();
+    _shards[s].push_chain( first_, last_ );
+    _map.mark( s );
+  }
+  const T* pop() {
+    const T* val = nullptr;
+    _map.next( [this, &val] ( std::size_t s_ ) { return ( val = _shards[s_].pop() ) != nullptr; },
+               is_empty() );
+    return val;
+  }
+  template<typename Backoff = detail::SpinYieldBackoff<>>
+  const T* waiting_pop() {
+    Backoff backoff;
+    const T* val;
+    while( ( val = pop() ) == nullptr && _map.any() ) {
+      backoff();
+    }
+    return val;
+  }
+  template<typename OutputIt>
+  std::size_t pop_bulk( OutputIt out_, std::size_t max_ ) {
+    std::size_t n = 0;
+    const T* val;
+    while( n < max_ && ( val = pop() ) != nullptr ) {
+      *out_++ = val;
+      ++n;
+    }
+    return n;
+  }
+  template<typename F>
+  std::size_t consume_all( F f_ ) {
+    return _map.drain( [this, &f_] ( std::size_t s_ ) {
+                         return _shards[s_].consume_all( [&f_] ( const T& val_ ) { f_( val_ ); } );
+                       }, is_empty() );
+  }
+private:
+  struct IsEmpty {
+    bool operator()( std::size_t s_ ) const { return _shards[s_].is_empty(); }
+    const Shard* _shards;
+  };
+  IsEmpty is_empty() const { return IsEmpty{ _shards }; }
+private:
+  Shard                      _shards[Shards];
+  alignas( Padding::alignment ) detail::ShardMap<Shards> _map;
+};
+
+template<typename T, std::size_t Shards, typename Alloc, typename Padding>
+constexpr std::size_t ShardedMPSCQueue<T, Shards, Alloc, Padding>::shards;
+
+template<class T, std::size_t Shards, typename Padding>
+constexpr std::size_t ShardedMPSCIntrQueue<T, Shards, Padding>::shards;
+
+} //namespace znl
+
+#endif //ZNL_SHARDED_QUEUE_HPP_INCLUDED
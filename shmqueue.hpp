@@ -0,0 +1,253 @@
+//  Lock-free MPSC queue between processes over POSIX shared memory
+//
+//  Copyright (C) 2018 Zoltan N. Leskowsky
+//
+//  Distributed under the Boost Software License, Version 1.0. (See
+//  accompanying file LICENSE_1_0.txt or copy at
+//  http://www.boost.org/LICENSE_1_0.txt)
+
+#ifndef ZNL_SHM_QUEUE_HPP_INCLUDED
+#define ZNL_SHM_QUEUE_HPP_INCLUDED
+
+#include <atomic>
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <string>
+#include <system_error>
+#include <thread>
+#include <type_traits>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "mpscqueue.hpp"
+
+#ifdef BOOST_HAS_PRAGMA_ONCE
+#pragma once
+#endif
+
+
+#if defined(_MSC_VER)
+#endif
+
+
+namespace znl {
+
+// MPSCQueue whose nodes, links and node pool all live in one shared mapping,
+// so that producers in other processes push without copying through the
+// kernel. Each process maps the segment at its own address, so links are
+// node offsets into the segment rather than pointers.
+//
+// The queue is Vyukov's non-intrusive MPSC queue as in MPSCQueue. Nodes come
+// from a fixed pool of Capacity nodes kept on a Treiber stack whose head is
+// tagged against ABA; a popped node's free link is read while another
+// process may be reusing it, which is harmless as the segment is never
+// unmapped while in use and the tagged CAS then fails. push() waits while the
+// pool is empty.
+//
+// T must be trivially copyable: it is copied into and out of the segment
+// byte for byte and never destroyed there.
+//
+// The default constructor maps an anonymous segment that is shared with
+// children forked afterwards. The named constructors create or open a
+// segment under /dev/shm; the creator unlinks the name when destroyed.
+// Errors throw std::system_error.
+
+template<typename T, std::uint32_t Capacity = 4096, typename Padding = CacheLinePadding<>>
+class ShmMPSCQueue
+{
+  static_assert( std::is_trivially_copyable<T>::value, "T must be trivially copyable" );
+  static_assert( Capacity > 0 && Capacity < std::numeric_limits<std::uint32_t>::max() - 1,
+                 "Capacity out of range" );
+  typedef std::uint32_t Offset;
+  static constexpr Offset nil = std::numeric_limits<Offset>::max();
+  static constexpr std::uint64_t magic = 0x7a6e6c73686d7131ull; // "znlshmq1"
+
+  struct Node {
+    std::atomic<Offset> _next;
+    std::atomic<Offset> _free_next;
+    T                   _value;
+  };
+  struct Segment {
+    std::atomic<std::uint64_t>                  _magic; // set last
+    std::uint64_t                               _size;
+    alignas( Padding::alignment ) std::atomic<Offset>        _last;
+    alignas( Padding::alignment ) std::atomic<Offset>        _first;
+    alignas( Padding::alignment ) std::atomic<std::uint64_t> _free; // tag << 32 | offset
+    alignas( Padding::alignment ) Node                       _nodes[Capacity + 1]; // + stub
+  };
+  static_assert( ATOMIC_INT_LOCK_FREE == 2 && ATOMIC_LLONG_LOCK_FREE == 2,
+                 "atomics shared between processes must be lock-free" );
+
+public:
+  struct Create {};
+  struct Open {};
+  static constexpr std::uint32_t capacity = Capacity;
+
+  ShmMPSCQueue() : _owner( true ) {
+    _segment = map( -1, MAP_SHARED | MAP_ANONYMOUS );
+    init();
+  }
+  ShmMPSCQueue( const std::string& name_, Create ) : _name( name_ ), _owner( true ) {
+    const int fd = ::shm_open( name_.c_str(), O_RDWR | O_CREAT | O_EXCL, 0600 );
+    if( fd < 0 ) {
+      throw std::system_error( errno, std::system_category(), "shm_open " + name_ );
+    }
+    if( ::ftruncate( fd, sizeof( Segment ) ) != 0 ) {
+      const int err = errno;
+      ::close( fd );
+      ::shm_unlink( name_.c_str() );
+      throw std::system_error( err, std::system_category(), "ftruncate " + name_ );
+    }
+    _segment = map( fd, MAP_SHARED );
+    ::close( fd );
+    init();
+  }
+  ShmMPSCQueue( const std::string& name_, Open ) : _name( name_ ), _owner( false ) {
+    const int fd = ::shm_open( name_.c_str(), O_RDWR, 0 );
+    if( fd < 0 ) {
+      throw std::system_error( errno, std::system_category(), "shm_open " + name_ );
+    }
+    _segment = map( fd, MAP_SHARED );
+    ::close( fd );
+    if( _segment->_magic.load( std::memory_order_acquire ) != magic ||
+        _segment->_size != sizeof( Segment ) ) {
+      ::munmap( _segment, sizeof( Segment ) );
+      throw std::system_error( EINVAL, std::system_category(), "not a matching queue " + name_ );
+    }
+  }
+  ShmMPSCQueue( const ShmMPSCQueue& ) = delete;
+  ShmMPSCQueue& operator=( const ShmMPSCQueue& ) = delete;
+  ~ShmMPSCQueue() {
+    ::munmap( _segment, sizeof( Segment ) );
+    if( _owner && !_name.empty() ) {
+      ::shm_unlink( _name.c_str() );
+    }
+  }
+
+  bool try_push( const T& value_ ) {
+    const Offset node = allocate();
+    if( node == nil ) {
+      return false;
+    }
+    link( node, value_ );
+    return true;
+  }
+  void push( const T& value_ ) {
+    Offset node;
+    while( ( node = allocate() ) == nil ) {
+      std::this_thread::yield(); // pool empty
+    }
+    link( node, value_ );
+  }
+  bool pop( T& value_ ) { return consume( [&value_] ( T& v_ ) { value_ = v_; }, 1 ) != 0; }
+  template<typename Backoff = detail::SpinYieldBackoff<>>
+  bool waiting_pop( T& value_ ) {
+    Backoff backoff;
+    while( !pop( value_ ) ) {
+      const Offset first = _segment->_first.load( std::memory_order_relaxed );
+      if( first == _segment->_last.load( std::memory_order_acquire ) ) {
+        return false; // empty, no push in process
+      }
+      backoff();
+    }
+    return true;
+  }
+  template<typename OutputIt>
+  std::size_t pop_bulk( OutputIt out_, std::size_t max_ ) {
+    return consume( [&out_] ( T& value_ ) { *out_++ = value_; }, max_ );
+  }
+  template<typename F>
+  std::size_t consume_all( F f_ ) {
+    return consume( f_, std::numeric_limits<std::size_t>::max() );
+  }
+
+private:
+  static Segment* map( int fd_, int flags_ ) {
+    void* p = ::mmap( nullptr, sizeof( Segment ), PROT_READ | PROT_WRITE, flags_, fd_, 0 );
+    if( p == MAP_FAILED ) {
+      throw std::system_error( errno, std::system_category(), "mmap" );
+    }
+    return static_cast<Segment*>( p );
+  }
+  void init() {
+    Segment& seg = *_segment;
+    for( Offset i = 0; i <= Capacity; ++i ) {
+      seg._nodes[i]._next.store( nil, std::memory_order_relaxed );
+      seg._nodes[i]._free_next.store( i + 1 < Capacity ? i + 1 : nil, std::memory_order_relaxed );
+    }
+    seg._last.store( Capacity, std::memory_order_relaxed ); // stub
+    seg._first.store( Capacity, std::memory_order_relaxed );
+    seg._free.store( 0, std::memory_order_relaxed );
+    seg._size = sizeof( Segment );
+    seg._magic.store( magic, std::memory_order_release );
+  }
+  Node& node( Offset offset_ ) const { return _segment->_nodes[offset_]; }
+  Offset allocate() {
+    std::uint64_t head = _segment->_free.load( std::memory_order_acquire );
+    for( ;; ) {
+      const Offset offset = static_cast<Offset>( head );
+      if( offset == nil ) {
+        return nil;
+      }
+      const Offset next = node( offset )._free_next.load( std::memory_order_relaxed );
+      const std::uint64_t tag = ( head >> 32 ) + 1;
+      if( _segment->_free.compare_exchange_weak( head, tag << 32 | next,
+                                                 std::memory_order_acquire,
+                                                 std::memory_order_acquire ) ) {
+        return offset;
+      }
+    }
+  }
+  void deallocate( Offset offset_ ) {
+    std::uint64_t head = _segment->_free.load( std::memory_order_relaxed );
+    do {
+      node( offset_ )._free_next.store( static_cast<Offset>( head ), std::memory_order_relaxed );
+    } while( !_segment->_free.compare_exchange_weak( head, ( ( head >> 32 ) + 1 ) << 32 | offset_,
+                                                     std::memory_order_release,
+                                                     std::memory_order_relaxed ) );
+  }
+  void link( Offset offset_, const T& value_ ) {
+    Node& n = node( offset_ );
+    n._value = value_;
+    n._next.store( nil, std::memory_order_relaxed );
+    const Offset prev = _segment->_last.exchange( offset_, std::memory_order_acq_rel );
+    node( prev )._next.store( offset_, std::memory_order_release );
+  }
+  template<typename F>
+  std::size_t consume( F&& f_, std::size_t max_ ) {
+    Offset first = _segment->_first.load( std::memory_order_relaxed );
+    std::size_t n = 0;
+    while( n < max_ ) {
+      const Offset next = node( first )._next.load( std::memory_order_acquire );
+      if( next == nil ) {
+        break; // empty, or a push in process
+      }
+      f_( node( next )._value ); // next becomes the stub
+      deallocate( first );
+      first = next;
+      ++n;
+    }
+    _segment->_first.store( first, std::memory_order_relaxed );
+    return n;
+  }
+
+private:
+  Segment*    _segment;
+  std::string _name;
+  bool        _owner;
+};
+
+template<typename T, std::uint32_t Capacity, typename Padding>
+constexpr std::uint32_t ShmMPSCQueue<T, Capacity, Padding>::capacity;
+
+template<typename T, std::uint32_t Capacity, typename Padding>
+constexpr typename ShmMPSCQueue<T, Capacity, Padding>::Offset ShmMPSCQueue<T, Capacity, Padding>::nil;
+
+} //namespace znl
+
+#endif //ZNL_SHM_QUEUE_HPP_INCLUDED
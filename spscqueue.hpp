@@ -0,0 +1,255 @@
+//  Wait-free SPSC bounded and unbounded queues
+//
+//  Copyright (C) 2018 Zoltan N. Leskowsky
+//
+//  Distributed under the Boost Software License, Version 1.0. (See
+//  accompanying file LICENSE_1_0.txt or copy at
+//  http://www.boost.org/LICENSE_1_0.txt)
+
+#ifndef ZNL_SPSC_QUEUE_HPP_INCLUDED
+#define ZNL_SPSC_QUEUE_HPP_INCLUDED
+
+#include <atomic>
+#include <cstddef>
+#include <limits>
+#include <thread>
+#include <utility>
+
+#include "mpscqueue.hpp"
+
+#ifdef BOOST_HAS_PRAGMA_ONCE
+#pragma once
+#endif
+
+
+#if defined(_MSC_VER)
+#endif
+
+
+namespace znl {
+
+// Ring of N slots for exactly one producer and one consumer thread. Each
+// side owns its index and keeps a cached copy of the other's, re-reading the
+// shared one only when the cache says full (producer) or empty (consumer),
+// so a push or pop is a plain store plus one release store.
+//
+// push()/pop() match MPSCQueue; push() waits for space when the ring is full.
+
+template<typename T, std::size_t N, typename Padding = CacheLinePadding<>>
+class BoundedSPSCQueue
+{
+  static_assert( N >= 2 && ( N & ( N - 1 ) ) == 0, "N must be a power of 2" );
+public:
+  static constexpr std::size_t capacity = N;
+
+  BoundedSPSCQueue() : _tail( 0 ), _head_cache( 0 ), _head( 0 ), _tail_cache( 0 ) {}
+  BoundedSPSCQueue( const BoundedSPSCQueue& ) = delete;
+  BoundedSPSCQueue& operator=( const BoundedSPSCQueue& ) = delete;
+
+  bool try_push( const T& value_ ) {
+    if( !has_space() ) {
+      return false;
+    }
+    write( value_ );
+    return true;
+  }
+  bool try_push( T&& value_ ) {
+    if( !has_space() ) {
+      return false;
+    }
+    write( std::move( value_ ) );
+    return true;
+  }
+  void push( const T& value_ ) {
+    wait_for_space();
+    write( value_ );
+  }
+  void push( T&& value_ ) {
+    wait_for_space();
+    write( std::move( value_ ) );
+  }
+  bool try_pop( T& value_ ) {
+    const std::size_t head = _head.load( std::memory_order_relaxed );
+    if( head == _tail_cache ) {
+      _tail_cache = _tail.load( std::memory_order_acquire );
+      if( head == _tail_cache ) {
+        return false;
+      }
+    }
+    value_ = std::move( _slots[head & ( N - 1 )] );
+    _head.store( head + 1, std::memory_order_release );
+    return true;
+  }
+  bool pop( T& value_ ) { return try_pop( value_ ); }
+  template<typename /*Backoff*/ = void> // a push is never seen in process
+  bool waiting_pop( T& value_ ) { return try_pop( value_ ); }
+  template<typename OutputIt>
+  std::size_t pop_bulk( OutputIt out_, std::size_t max_ ) {
+    return consume( [&out_] ( T& value_ ) { *out_++ = std::move( value_ ); }, max_ );
+  }
+  template<typename F>
+  std::size_t consume_all( F f_ ) {
+    return consume( f_, std::numeric_limits<std::size_t>::max() );
+  }
+
+private:
+  bool has_space() {
+    const std::size_t tail = _tail.load( std::memory_order_relaxed );
+    if( tail - _head_cache == N ) {
+      _head_cache = _head.load( std::memory_order_acquire );
+      return tail - _head_cache != N;
+    }
+    return true;
+  }
+  void wait_for_space() {
+    while( !has_space() ) {
+      std::this_thread::yield(); // full
+    }
+  }
+  template<typename U>
+  void write( U&& value_ ) {
+    const std::size_t tail = _tail.load( std::memory_order_relaxed );
+    _slots[tail & ( N - 1 )] = std::forward<U>( value_ );
+    _tail.store( tail + 1, std::memory_order_release );
+  }
+  template<typename F>
+  std::size_t consume( F&& f_, std::size_t max_ ) {
+    std::size_t head = _head.load( std::memory_order_relaxed );
+    std::size_t n = 0;
+    while( n < max_ ) {
+      if( head == _tail_cache ) {
+        _tail_cache = _tail.load( std::memory_order_acquire );
+        if( head == _tail_cache ) {
+          break;
+        }
+      }
+      f_( _slots[head & ( N - 1 )] );
+      ++head;
+      ++n;
+    }
+    _head.store( head, std::memory_order_release );
+    return n;
+  }
+
+private:
+  // producer
+  alignas( Padding::alignment ) std::atomic<std::size_t> _tail;
+  std::size_t _head_cache;
+  // consumer
+  alignas( Padding::alignment ) std::atomic<std::size_t> _head;
+  std::size_t _tail_cache;
+  alignas( Padding::alignment ) T _slots[N];
+};
+
+template<typename T, std::size_t N, typename Padding>
+constexpr std::size_t BoundedSPSCQueue<T, N, Padding>::capacity;
+
+// Unbounded queue of linked blocks of BlockSize slots. The producer fills the
+// tail block and links a new one when it is full; the consumer drains the
+// head block and hands it back through a one-block spare, so a steady stream
+// allocates nothing. Only block links and per-block counts are shared.
+
+template<typename T, std::size_t BlockSize = 256, typename Padding = CacheLinePadding<>>
+class SPSCQueue
+{
+  static_assert( BlockSize > 0, "BlockSize must be positive" );
+  struct Block {
+    Block() : _count( 0 ), _next( nullptr ) {}
+    std::atomic<std::size_t> _count; // published slots
+    std::atomic<Block*>      _next;
+    T                        _values[BlockSize];
+  };
+public:
+  SPSCQueue() : _tail( new Block ), _write( 0 ),
+    _head( _tail ), _read( 0 ), _avail( 0 ), _spare( nullptr ) {}
+  SPSCQueue( const SPSCQueue& ) = delete;
+  SPSCQueue& operator=( const SPSCQueue& ) = delete;
+  ~SPSCQueue() {
+    Block* next;
+    for( Block* block = _head; block; block = next ) {
+      next = block->_next.load( std::memory_order_relaxed );
+      delete block;
+    }
+    delete _spare.load( std::memory_order_relaxed );
+  }
+  void push( const T& value_ ) { write( value_ ); }
+  void push( T&& value_ ) { write( std::move( value_ ) ); }
+  bool try_push( const T& value_ ) { write( value_ ); return true; }
+  bool try_push( T&& value_ ) { write( std::move( value_ ) ); return true; }
+  bool try_pop( T& value_ ) {
+    return consume( [&value_] ( T& v_ ) { value_ = std::move( v_ ); }, 1 ) != 0;
+  }
+  bool pop( T& value_ ) { return try_pop( value_ ); }
+  template<typename /*Backoff*/ = void> // a push is never seen in process
+  bool waiting_pop( T& value_ ) { return try_pop( value_ ); }
+  template<typename OutputIt>
+  std::size_t pop_bulk( OutputIt out_, std::size_t max_ ) {
+    return consume( [&out_] ( T& value_ ) { *out_++ = std::move( value_ ); }, max_ );
+  }
+  template<typename F>
+  std::size_t consume_all( F f_ ) {
+    return consume( f_, std::numeric_limits<std::size_t>::max() );
+  }
+
+private:
+  template<typename U>
+  void write( U&& value_ ) {
+    if( _write == BlockSize ) {
+      Block* block = _spare.exchange( nullptr, std::memory_order_acquire );
+      if( block ) {
+        block->_count.store( 0, std::memory_order_relaxed );
+        block->_next.store( nullptr, std::memory_order_relaxed );
+      } else {
+        block = new Block;
+      }
+      _tail->_next.store( block, std::memory_order_release );
+      _tail = block;
+      _write = 0;
+    }
+    _tail->_values[_write] = std::forward<U>( value_ );
+    _tail->_count.store( ++_write, std::memory_order_release );
+  }
+  template<typename F>
+  std::size_t consume( F&& f_, std::size_t max_ ) {
+    std::size_t n = 0;
+    while( n < max_ ) {
+      if( _read == _avail ) {
+        _avail = _head->_count.load( std::memory_order_acquire );
+        if( _read == _avail ) {
+          if( _read != BlockSize ) {
+            break; // empty
+          }
+          Block* next = _head->_next.load( std::memory_order_acquire );
+          if( !next ) {
+            break; // empty, producer has not moved on yet
+          }
+          recycle( _head );
+          _head = next;
+          _read = _avail = 0;
+          continue;
+        }
+      }
+      f_( _head->_values[_read++] );
+      ++n;
+    }
+    return n;
+  }
+  void recycle( Block* block_ ) {
+    Block* old = _spare.exchange( block_, std::memory_order_release );
+    delete old;
+  }
+
+private:
+  // producer
+  alignas( Padding::alignment ) Block* _tail;
+  std::size_t _write;
+  // consumer
+  alignas( Padding::alignment ) Block* _head;
+  std::size_t _read;
+  std::size_t _avail;
+  alignas( Padding::alignment ) std::atomic<Block*> _spare;
+};
+
+} //namespace znl
+
+#endif //ZNL_SPSC_QUEUE_HPP_INCLUDED
@@ -0,0 +1,161 @@
+//  Dependency graph of tasks run on a WorkerPool
+//
+//  Copyright (C) 2018 Zoltan N. Leskowsky
+//
+//  Distributed under the Boost Software License, Version 1.0. (See
+//  accompanying file LICENSE_1_0.txt or copy at
+//  http://www.boost.org/LICENSE_1_0.txt)
+
+#include <climits>
+#include <stdexcept>
+#include "taskgraph.hpp"
+
+#if defined(__linux__)
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#else
+#include <thread>
+#endif
+
+#ifndef ZNL_WORKER_SPSC
+
+namespace znl {
+
+TaskGraph::Node TaskGraph::emplace( Func&& func_ )
+{
+  const Node node = _nodes.size();
+  _nodes.emplace_back( std::move( func_ ), this, node );
+  _sealed = false;
+  return node;
+}
+
+void TaskGraph::precede( Node before_, Node after_ )
+{
+  if( before_ >= _nodes.size() || after_ >= _nodes.size() ) {
+    throw std::out_of_range( "TaskGraph::precede" );
+  }
+  _edges.emplace_back( before_, after_ );
+  _sealed = false;
+}
+
+void TaskGraph::run( WorkerPool& pool_ )
+{
+  if( !_sealed ) {
+    seal();
+  }
+  _pool = &pool_;
+  for( Vertex& vertex : _nodes ) {
+    vertex.pending.store( vertex.preds, std::memory_order_relaxed );
+  }
+  // spawn() publishes these with the Task
+  _remaining.store( static_cast<std::uint32_t>( _nodes.size() ), std::memory_order_relaxed );
+  for( Node node : _sources ) {
+    pool_.spawn( _nodes[node].task );
+  }
+}
+
+void TaskGraph::wait()
+{
+  std::uint32_t remaining = _remaining.load( std::memory_order_acquire );
+  while( remaining & ~waiting ) {
+    if( !( remaining & waiting ) &&
+        !_remaining.compare_exchange_weak( remaining, remaining | waiting, std::memory_order_acquire ) ) {
+      continue;
+    }
+    park( remaining | waiting );
+    remaining = _remaining.load( std::memory_order_acquire );
+  }
+}
+
+// Successors by counting sort on the predecessor, then Kahn's algorithm to
+// find a cycle.
+void TaskGraph::seal()
+{
+  const std::size_t n = _nodes.size();
+  std::vector<std::size_t> start( n + 1, 0 );
+  for( Vertex& vertex : _nodes ) {
+    vertex.preds = 0;
+  }
+  for( const std::pair<Node, Node>& edge : _edges ) {
+    ++start[edge.first + 1];
+    ++_nodes[edge.second].preds;
+  }
+  for( std::size_t i = 0; i < n; ++i ) {
+    start[i + 1] += start[i];
+    _nodes[i].first = _nodes[i].last = start[i];
+  }
+  _succ.resize( _edges.size() );
+  for( const std::pair<Node, Node>& edge : _edges ) {
+    _succ[_nodes[edge.first].last++] = edge.second;
+  }
+
+  _sources.clear();
+  std::vector<std::uint32_t> pending( n );
+  std::vector<Node> ready;
+  for( std::size_t i = 0; i < n; ++i ) {
+    pending[i] = _nodes[i].preds;
+    if( !pending[i] ) {
+      _sources.push_back( i );
+      ready.push_back( i );
+    }
+  }
+  std::size_t visited = 0;
+  while( !ready.empty() ) {
+    const Vertex& vertex = _nodes[ready.back()];
+    ready.pop_back();
+    ++visited;
+    for( std::size_t i = vertex.first; i < vertex.last; ++i ) {
+      if( !--pending[_succ[i]] ) {
+        ready.push_back( _succ[i] );
+      }
+    }
+  }
+  if( visited != n ) {
+    throw std::invalid_argument( "TaskGraph has a cycle" );
+  }
+  _sealed = true;
+}
+
+// The node's Task, on a Worker of _pool.
+void TaskGraph::complete( Node node_ )
+{
+  const Vertex& vertex = _nodes[node_];
+  vertex.func();
+  for( std::size_t i = vertex.first; i < vertex.last; ++i ) {
+    Vertex& succ = _nodes[_succ[i]];
+    if( succ.pending.fetch_sub( 1, std::memory_order_acq_rel ) == 1 ) {
+      _pool->spawn( succ.task );
+    }
+  }
+  if( _remaining.fetch_sub( 1, std::memory_order_acq_rel ) == ( waiting | 1 ) ) {
+    wake(); // this may be run again or freed by now; a stray wake is harmless
+  }
+}
+
+#if defined(__linux__)
+void TaskGraph::park( std::uint32_t remaining_ )
+{
+  ::syscall( SYS_futex, reinterpret_cast<std::uint32_t*>( &_remaining ), FUTEX_WAIT_PRIVATE,
+             remaining_, nullptr, nullptr, 0 );
+}
+
+void TaskGraph::wake()
+{
+  ::syscall( SYS_futex, reinterpret_cast<std::uint32_t*>( &_remaining ), FUTEX_WAKE_PRIVATE,
+             INT_MAX, nullptr, nullptr, 0 );
+}
+#else
+void TaskGraph::park( std::uint32_t remaining_ )
+{
+  while( _remaining.load( std::memory_order_acquire ) == remaining_ ) {
+    std::this_thread::yield();
+  }
+}
+
+void TaskGraph::wake() {}
+#endif
+
+} //namespace znl
+
+#endif //ZNL_WORKER_SPSC
@@ -0,0 +1,112 @@
+//  Dependency graph of tasks run on a WorkerPool
+//
+//  Copyright (C) 2018 Zoltan N. Leskowsky
+//
+//  Distributed under the Boost Software License, Version 1.0. (See
+//  accompanying file LICENSE_1_0.txt or copy at
+//  http://www.boost.org/LICENSE_1_0.txt)
+
+#ifndef ZNL_TASK_GRAPH_HPP_INCLUDED
+#define ZNL_TASK_GRAPH_HPP_INCLUDED
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <utility>
+#include <vector>
+
+#include "taskqueue.hpp"
+#include "workerpool.hpp"
+
+#ifdef BOOST_HAS_PRAGMA_ONCE
+#pragma once
+#endif
+
+
+#if defined(_MSC_VER)
+#endif
+
+#ifndef ZNL_WORKER_SPSC
+
+namespace znl {
+
+// Nodes and edges declared once, then run as often as needed:
+//
+//   TaskGraph graph;
+//   TaskGraph::Node load = graph.emplace( ... ), a = graph.emplace( ... ),
+//                   b = graph.emplace( ... ), join = graph.emplace( ... );
+//   graph.precede( load, a ); graph.precede( load, b );
+//   graph.precede( a, join ); graph.precede( b, join );
+//   for( ;; ) { graph.run( pool ); graph.wait(); }
+//
+// Each node owns a Task and an atomic count of the predecessors still to
+// run. A node that finishes counts down its successors, and spawns those it
+// brings to zero onto the deque of the Worker running it, where the Worker
+// takes the last one next and idle Workers may steal the others; nodes
+// without predecessors are spawned by run(). The first run() after a change
+// lays the edges out in one array and checks for cycles; later runs only
+// reset the counts and allocate nothing.
+//
+// A node runs once per run(), after all of its predecessors and on any of
+// the pool's Workers. run() must not be called again, nor the graph changed
+// or destroyed, before the previous run is done.
+
+class TaskGraph
+{
+public:
+  typedef std::size_t Node;
+
+  TaskGraph() : _pool( nullptr ), _remaining( 0 ), _sealed( true ) {}
+  TaskGraph( const TaskGraph& ) = delete;
+  TaskGraph& operator=( const TaskGraph& ) = delete;
+
+  std::size_t size() const { return _nodes.size(); }
+  Node emplace( Func&& func_ );
+  // before_ finishes before after_ starts. Throws std::out_of_range.
+  void precede( Node before_, Node after_ );
+  // Spawns the nodes without predecessors and returns. Throws
+  // std::invalid_argument if the edges make a cycle.
+  void run( WorkerPool& pool_ );
+  bool is_done() const { return !( _remaining.load( std::memory_order_acquire ) & ~waiting ); }
+  // Not from a task on the same pool. The graph may be run again or
+  // destroyed as soon as it returns.
+  void wait();
+
+private:
+  static constexpr std::uint32_t waiting = 0x80000000u; // in _remaining
+
+  struct Vertex
+  {
+    Vertex( Func&& func_, TaskGraph* graph_, Node node_ )
+      : func( std::move( func_ ) ), task( Func( [graph_, node_] () { graph_->complete( node_ ); } ) ),
+        pending( 0 ), preds( 0 ), first( 0 ), last( 0 ) {}
+
+    Func                       func;
+    Task                       task;
+    std::atomic<std::uint32_t> pending;
+    std::uint32_t              preds;
+    std::size_t                first; // successors in _succ
+    std::size_t                last;
+  };
+
+  void seal();
+  void complete( Node node_ );
+  void park( std::uint32_t remaining_ );
+  void wake();
+
+private:
+  std::deque<Vertex>                 _nodes;
+  std::vector<std::pair<Node, Node>> _edges;
+  std::vector<Node>                  _succ;
+  std::vector<Node>                  _sources;
+  WorkerPool*                        _pool;
+  std::atomic<std::uint32_t>         _remaining; // futex word: nodes left, and waiting
+  bool                               _sealed;
+};
+
+} //namespace znl
+
+#endif //ZNL_WORKER_SPSC
+
+#endif //ZNL_TASK_GRAPH_HPP_INCLUDED
@@ -9,8 +9,15 @@
 #ifndef ZNL_TASK_QUEUE_HPP_INCLUDED
 #define ZNL_TASK_QUEUE_HPP_INCLUDED
 
+#include "inplacetask.hpp"
 #include "mpscqueue.hpp"
+#ifdef ZNL_STD_FUNCTION_TASK
 #include <functional>
+#endif
+#ifdef ZNL_WORKER_METRICS
+#include <atomic>
+#include <cstdint>
+#endif
 
 #ifdef BOOST_HAS_PRAGMA_ONCE
 #pragma once
@@ -21,34 +28,32 @@
 #endif
 
 
+//#define ZNL_STD_FUNCTION_TASK // copyable std::function<void()> as Func
+
 namespace znl {
 namespace detail {
 } //namespace detail
 
+#ifdef ZNL_STD_FUNCTION_TASK
 typedef std::function<void()> Func;
+#else
+typedef InplaceTask<> Func;
+#endif
 
+// Move-only, like InplaceTask: a Task is built from, or assigned, a Func
+// rvalue, and its captures are moved, never copied.
 class Task : public MPSCNode<Func>
 {
 public:
   Task() = default;
-  Task( const Task &task_ ) //= delete;
-    : MPSCNode<Func>( task_ ) {}
+  Task( const Task& ) = delete;
   Task( Task &&task_ )
     : MPSCNode<Func>( std::move( task_ ) ) {}
-  Task( const Func &func_ ) //= delete;
-    : MPSCNode<Func>( func_ ) {}
   Task( Func &&func_ )
     : MPSCNode<Func>( std::move( func_ ) ) {}
-  Task& operator=( const Task &task_ ) { //= delete;
-    set_value( task_.get_value() );
-    return *this;
-  }
-  //Task& operator=( Task &&task_ ) {
-  //  set_value( task_.get_move_value() );
-  //  return *this;
-  //}
-  Task& operator=( const Func &func_ ) { //= delete;
-    MPSCNode<Func>::set_value( func_ );
+  Task& operator=( const Task& ) = delete;
+  Task& operator=( Task &&task_ ) {
+    MPSCNode<Func>::operator=( std::move( task_ ) );
     return *this;
   }
   Task& operator=( Func &&func_ ) {
@@ -58,15 +63,53 @@ public:
   void operator()() const { get_value()(); }
   operator bool() const { return static_cast<bool>( get_value() ); }
   bool operator!() const { return !get_value(); }
+  // Set on Tasks allocated from the consumer's own TaskPool, which it
+  // deallocates once they have run.
+  bool is_pooled() const { return _pooled; }
+  void set_pooled() { _pooled = true; }
+#ifdef ZNL_WORKER_METRICS
+  // steady_clock nanoseconds at the last send, for Worker::stats().
+  std::uint64_t sent_ns() const { return _sent_ns.load( std::memory_order_relaxed ); }
+  void set_sent_ns( std::uint64_t ns_ ) const { _sent_ns.store( ns_, std::memory_order_relaxed ); }
+#endif
+private:
+  bool _pooled = false;
+#ifdef ZNL_WORKER_METRICS
+  mutable std::atomic<std::uint64_t> _sent_ns{ 0 }; // a ring mailbox may hold a Task twice
+#endif
 };
  
 template<> inline
 void MPSCQueue<Func>::assign_or_move( Func& to_, Func& from_ ) { move_value( to_, from_ ); }
 
 using FuncQueue = MPSCQueue<Func>;
-using TaskQueue = MPSCIntrQueue<Task>; //TODO: get this to work
+using TaskQueue = MPSCIntrQueue<Task>;
 //using TaskQueue = MPSCQueue<Task>;
 
+// Owns Tasks pushed by value onto a TaskQueue: producers allocate, the
+// consumer deallocates once the Task has run.
+using TaskPool = NodePool<Task>;
+
+// Gives a value queue of const Task*, e.g. BoundedMPSCQueue or SPSCQueue,
+// the push( const Task& )/pop() surface of TaskQueue.
+template<class Queue>
+class TaskPtrQueue
+{
+public:
+  void push( const Task& task_ ) { _queue.push( &task_ ); }
+  const Task* pop() {
+    const Task* ptask;
+    return _queue.pop( ptask ) ? ptask : nullptr;
+  }
+  template<typename Backoff = detail::SpinYieldBackoff<>>
+  const Task* waiting_pop() {
+    const Task* ptask;
+    return _queue.template waiting_pop<Backoff>( ptask ) ? ptask : nullptr;
+  }
+private:
+  Queue _queue;
+};
+
 } //namespace znl
 
 #endif //ZNL_TASK_QUEUE_HPP_INCLUDED
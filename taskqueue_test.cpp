@@ -8,25 +8,91 @@
 
 #include "actor.hpp"
 #include "logger.hpp"
+#include "taskgraph.hpp"
 #include "taskqueue.hpp"
 #include "worker.hpp"
+#include "workerpool.hpp"
+#include <atomic>
+#include <chrono>
 #include <cstdlib>
+#include <fstream>
+#include <future>
 //#include <cstring>
 #include <iostream>
+#include <memory>
 #include <string>
 #include <sstream>
+#include <stdexcept>
 #include <thread>
+#include <sched.h>
+#include <sys/stat.h>
 #include <unistd.h>
 #include <vector>
 
 using namespace std;
 using namespace znl;
 
+#if defined(ZNL_WORKER_WAIT)
+#define WORKER_WAKEUP "wait strategy"
+#elif defined(ZNL_MULTIUSE_FUTURE)
+#define WORKER_WAKEUP "promise"
+#elif defined(ZNL_WORKER_CONDVAR)
+#define WORKER_WAKEUP "condvar"
+#else
+#define WORKER_WAKEUP "eventcount"
+#endif
+
 void func()
 {
   Log.log( "func" );
 }
 
+// Move-only callable; Pad bytes make it inline or heap-allocated in a Func.
+template<std::size_t Pad>
+struct AddTask
+{
+  AddTask( std::atomic<int>& sum_, int n_ ) : sum( &sum_ ), n( new int( n_ ) ), pad() {}
+  void operator()() { *sum += *n; }
+  std::atomic<int>*    sum;
+  std::unique_ptr<int> n;
+  char                 pad[Pad];
+};
+
+// Runs on one Worker and sends itself on to the other until rounds runs
+// out, so every send wakes a Worker that has gone idle.
+struct Ping
+{
+  void operator()() const {
+    if( --*rounds == 0 ) {
+      done->set_value();
+    } else {
+      peer->send( Ping{ peer, self, rounds, done } );
+    }
+  }
+  Worker*             self;
+  Worker*             peer;
+  int*                rounds;
+  std::promise<void>* done;
+};
+
+// Writes line_ to root_/path_, creating the directories on the way.
+void write_file( const std::string& root_, const std::string& path_, const std::string& line_ )
+{
+  for( std::size_t slash = 0; ( slash = path_.find( '/', slash + 1 ) ) != std::string::npos; ) {
+    ::mkdir( ( root_ + path_.substr( 0, slash ) ).c_str(), 0700 );
+  }
+  std::ofstream( root_ + path_ ) << line_ << std::endl;
+}
+
+std::string slot_cpus( const Placement& placement_ )
+{
+  std::stringstream ss;
+  for( std::size_t i = 0; i < placement_.size(); ++i ) {
+    ss << " " << placement_.cpu( i );
+  }
+  return ss.str();
+}
+
 int main()
 {
   LOG( "__cplusplus = " << __cplusplus );
@@ -89,7 +155,7 @@ int main()
   FuncQueue fqueue;
   fqueue.push( func1 );
   fqueue.push( func2 );
-  std::function<void()> ofunc;
+  Func ofunc;
   if( fqueue.pop( ofunc ) ) {
      ofunc();
   }
@@ -112,12 +178,391 @@ int main()
      ofunc();
   }
 
+  {
+  Actor actor( "Counter" );
+  const int nsends = 10000;
+  std::atomic<int> counter( 0 );
+  for( int si = 0; si < nsends; ++si ) {
+    actor.send( [&counter] () { ++counter; } );
+  }
+  while( actor.active() ) {
+    std::this_thread::yield();
+  }
+  LOG( "Actor ran " << counter << " of " << nsends << " tasks" );
+  }
+
+#ifndef ZNL_STD_FUNCTION_TASK
+  {
+  std::atomic<int> sum( 0 );
+  Func small( AddTask<1>( sum, 1 ) );
+  Func large( AddTask<2 * Func::inline_size>( sum, 2 ) );
+  Func moved( std::move( small ) );
+  moved();
+  large();
+  LOG( "Func move-only: " << ( !small && moved ? "moved" : "FAILED" )
+       << ", sum " << sum << " of 3" );
+  Actor actor( "Mover" );
+  actor.send( std::move( moved ) );
+  actor.send( std::move( large ) );
+  actor.send( AddTask<1>( sum, 4 ) );
+  while( actor.active() ) {
+    std::this_thread::yield();
+  }
+  Worker worker( "Mover" );
+  worker.start();
+  worker.send( AddTask<1>( sum, 8 ) );
+  worker.send( AddTask<2 * Func::inline_size>( sum, 16 ) );
+  worker.stop();
+  LOG( "Actor and Worker ran moved Funcs: sum " << sum << " of 34" );
+  }
+#endif
+
+  {
+  Worker ping( "Ping" ), pong( "Pong" );
+  ping.start();
+  pong.start();
+  const int nrounds = 20000;
+  int rounds = nrounds;
+  std::promise<void> done;
+  const auto t0 = std::chrono::steady_clock::now();
+  ping.send( Ping{ &ping, &pong, &rounds, &done } );
+  done.get_future().wait();
+  const auto t1 = std::chrono::steady_clock::now();
+  ping.stop();
+  pong.stop();
+  const double us = std::chrono::duration<double, std::micro>( t1 - t0 ).count();
+  LOG( "Worker ping-pong (" << WORKER_WAKEUP << "): " << ( us / nrounds ) << " us/send, idle "
+       << ping.idle_spins() << " spins, " << ping.idle_parks() << " parks" );
+  }
+
+  {
+  // stats() of a Worker sent a burst, sampled while it runs and once stopped
+  Worker metered( "Metered" );
+  metered.start();
+  const int ntasks = 1000;
+  std::atomic<int> sum( 0 );
+  for( int i = 0; i < ntasks; ++i ) {
+    metered.send( [&sum] () { sum.fetch_add( 1, std::memory_order_relaxed ); } );
+  }
+  std::uint64_t sampled = 0;
+  while( sum.load() < ntasks ) {
+    sampled = metered.stats().tasks;
+    std::this_thread::yield();
+  }
+  metered.stop();
+  const WorkerStats stats = metered.stats();
+#ifdef ZNL_WORKER_METRICS
+  const char* metrics = "";
+#else
+  const char* metrics = " (no ZNL_WORKER_METRICS)";
+#endif
+  LOG( "Worker stats" << metrics << ": " << stats.tasks << " of " << ntasks << " tasks ("
+       << sampled << " sampled), max depth " << stats.max_depth
+       << ", busy " << stats.busy_ns / 1000 << " us, idle " << stats.idle_ns / 1000 << " us, "
+       << stats.spins << " spins, " << stats.parks << " parks, " << stats.wakes << " wakes, "
+       << "queue wait p50 < " << stats.queue_wait.quantile_ns( 0.5 ) << " ns, p99 < "
+       << stats.queue_wait.quantile_ns( 0.99 ) << " ns, run p99 < "
+       << stats.run_time.quantile_ns( 0.99 ) << " ns" );
+  }
+
+  {
+  // send_after() and send_every(): thousands of pending timeouts, half of
+  // them cancelled, and a periodic timer, on a Worker that is otherwise idle
+  Worker timed( "Timed" );
+  timed.start();
+  const int ntimers = 2000;
+  std::atomic<int> nfired( 0 ), nearly( 0 ), nticks( 0 );
+  std::atomic<long long> late_us( 0 );
+  std::vector<Timer> cancelled;
+  for( int i = 0; i < ntimers; ++i ) {
+    const std::chrono::milliseconds delay( 1 + i % 50 );
+    const std::chrono::steady_clock::time_point due = std::chrono::steady_clock::now() + delay;
+    Timer timer = timed.send_after( delay, [&nfired, &nearly, &late_us, due] () {
+                                      const std::chrono::steady_clock::time_point now =
+                                        std::chrono::steady_clock::now();
+                                      nearly += now < due;
+                                      late_us += std::chrono::duration_cast<std::chrono::microseconds>(
+                                                   now - due ).count();
+                                      ++nfired;
+                                    } );
+    if( i % 2 ) {
+      cancelled.push_back( std::move( timer ) );
+    }
+  }
+  Timer every = timed.send_every( std::chrono::milliseconds( 10 ), [&nticks] () { ++nticks; } );
+  for( Timer& timer : cancelled ) {
+    timer.cancel();
+  }
+  std::this_thread::sleep_for( std::chrono::milliseconds( 105 ) );
+  every.cancel();
+  const int ticks = nticks;
+  std::this_thread::sleep_for( std::chrono::milliseconds( 30 ) );
+  timed.stop();
+  LOG( "Worker timers: " << ( nfired >= ntimers / 2 && nfired < ntimers ? "ok" : "FAILED" ) << ", "
+       << nfired << " of " << ntimers << " ran, half cancelled, " << nearly << " early, "
+       << ( nfired ? late_us / nfired : 0 ) << " us late on average; every 10 ms: " << ticks
+       << " in 105 ms, " << ( nticks == ticks ? "none" : "FAILED, some" ) << " after cancel()" );
+  }
+
+  {
+  // a pending timer makes an idle Worker wait with a timeout; every task
+  // that wakes it must still run
+  Worker timed( "Timed" );
+  timed.start();
+  Timer pending = timed.send_after( std::chrono::seconds( 10 ), [] () {} );
+  const int ntasks = 1000;
+  std::atomic<int> nran( 0 );
+  for( int i = 0; i < ntasks; ++i ) {
+    timed.send( [&nran] () { ++nran; } );
+    std::this_thread::sleep_for( std::chrono::microseconds( 20 ) );
+  }
+  const auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds( 2 );
+  while( nran < ntasks && std::chrono::steady_clock::now() < deadline ) {
+    std::this_thread::yield();
+  }
+  pending.cancel();
+  timed.stop();
+  LOG( "Worker tasks with a timer pending: " << ( nran == ntasks ? "ok" : "FAILED" ) << ", "
+       << nran << " of " << ntasks << " ran" );
+  }
+
+  {
+  // fan-out: 64 tasks per event, sent one by one and in a batch
+  Worker fanout( "Fanout" );
+  fanout.start();
+  const int nevents = 2000, ntasks = 64;
+  std::atomic<int> sum( 0 );
+  double us[2];
+  for( int batched = 0; batched < 2; ++batched ) {
+    sum = 0;
+    const auto t0 = std::chrono::steady_clock::now();
+    for( int e = 0; e < nevents; ++e ) {
+      if( batched ) {
+        Worker::Batcher batcher( fanout );
+        for( int j = 0; j < ntasks; ++j ) {
+          batcher.send( [&sum] () { ++sum; } );
+        }
+      } else {
+        for( int j = 0; j < ntasks; ++j ) {
+          fanout.send( [&sum] () { ++sum; } );
+        }
+      }
+    }
+    while( sum < nevents * ntasks ) {
+      std::this_thread::yield();
+    }
+    const auto t1 = std::chrono::steady_clock::now();
+    us[batched] = std::chrono::duration<double, std::micro>( t1 - t0 ).count() / nevents;
+  }
+  fanout.stop();
+  LOG( "Worker fan-out of " << ntasks << " (" << WORKER_WAKEUP << "): " << us[0] << " us/event sent singly, "
+       << us[1] << " us/event batched" );
+  }
+
+  {
+  Worker server( "Server" );
+  server.start();
+  const int ncalls = 20000;
+  long sums[2] = { 0, 0 };
+  const auto t0 = std::chrono::steady_clock::now();
+  for( int j = 0; j < ncalls; ++j ) {
+    sums[0] += server.submit( [j] () { return j; } ).get();
+  }
+  const auto t1 = std::chrono::steady_clock::now();
+  for( int j = 0; j < ncalls; ++j ) {
+    std::promise<int> promise;
+    std::future<int> future = promise.get_future();
+    server.send( [&promise, j] () { promise.set_value( j ); } );
+    sums[1] += future.get();
+  }
+  const auto t2 = std::chrono::steady_clock::now();
+  int got = 0;
+  std::promise<void> done;
+  server.submit( [] () { return 7; } ).then( [&got, &done] ( int value_ ) {
+                                                got = value_;
+                                                done.set_value();
+                                              } );
+  done.get_future().wait();
+  server.stop();
+  const double us[2] = { std::chrono::duration<double, std::micro>( t1 - t0 ).count() / ncalls,
+                         std::chrono::duration<double, std::micro>( t2 - t1 ).count() / ncalls };
+  LOG( "Worker submit/get: " << us[0] << " us/call, send with std::promise: " << us[1]
+       << " us/call, sums " << sums[0] << " " << sums[1] << ", then() got " << got );
+  }
+
+#ifndef ZNL_WORKER_SPSC
+  {
+  WorkerPool pool( 4 );
+  pool.start();
+  // tasks sent to one Worker are stolen, and run by the others while it is
+  // busy with one of them
+  std::atomic<int> nran( 0 ), nbusy0( 0 ), noverlapped( 0 );
+  Worker* const worker0 = &pool.worker( 0 );
+  const auto t0 = std::chrono::steady_clock::now();
+  for( int j = 0; j < 8; ++j ) {
+    worker0->send( [&nran, &nbusy0, &noverlapped, worker0] () {
+                     const bool on0 = WorkerPool::current() == worker0;
+                     nbusy0 += on0;
+                     std::this_thread::sleep_for( std::chrono::milliseconds( 50 ) );
+                     noverlapped += !on0 && nbusy0 > 0;
+                     nbusy0 -= on0;
+                     ++nran;
+                   } );
+  }
+  while( nran < 8 ) {
+    std::this_thread::yield();
+  }
+  const auto t1 = std::chrono::steady_clock::now();
+  const double ms = std::chrono::duration<double, std::milli>( t1 - t0 ).count();
+  LOG( "WorkerPool ran 8 x 50 ms sent to one Worker in " << ms << " ms: "
+       << ( noverlapped ? "ok" : "FAILED" ) << ", " << noverlapped
+       << " run by another Worker while it was busy" );
+  const int nchildren = 1000;
+  std::atomic<int> nspawned( 0 );
+  pool.send( [&pool, &nspawned] () {
+               for( int j = 0; j < nchildren; ++j ) {
+                 pool.spawn( [&nspawned] () { ++nspawned; } );
+               }
+             } );
+  while( nspawned < nchildren ) {
+    std::this_thread::yield();
+  }
+  std::atomic<int> ntimed( 0 );
+  Timer timer = pool.worker( pool.size() - 1 ).send_after( std::chrono::milliseconds( 5 ),
+                                                          [&ntimed] () { ++ntimed; } );
+  while( ntimed < 1 ) {
+    std::this_thread::yield();
+  }
+  // sends to one member should leave the others parked
+  auto others_parks = [&pool] () {
+    std::uint64_t parks = 0;
+    for( std::size_t i = 1; i < pool.size(); ++i ) {
+      parks += pool.worker( i ).stats().parks;
+    }
+    return parks;
+  };
+  std::this_thread::sleep_for( std::chrono::milliseconds( 10 ) );
+  const std::uint64_t parks0 = others_parks();
+  const int nsingle = 100;
+  std::atomic<int> nreceived( 0 );
+  for( int j = 0; j < nsingle; ++j ) {
+    pool.worker( 0 ).send( [&nreceived] () { ++nreceived; } );
+    std::this_thread::sleep_for( std::chrono::microseconds( 200 ) );
+  }
+  while( nreceived < nsingle ) {
+    std::this_thread::yield();
+  }
+  LOG( "WorkerPool: " << nsingle << " sends to one Worker, the others parked again "
+       << others_parks() - parks0 << " times" );
+  pool.stop();
+  const WorkerStats stats = pool.stats();
+  LOG( "WorkerPool ran " << nspawned << " of " << nchildren << " spawned tasks; stats: "
+       << stats.tasks << " tasks, " << stats.parks << " parks, busy "
+       << stats.busy_ns / 1000 << " us, queue wait p99 < " << stats.queue_wait.quantile_ns( 0.99 ) << " ns" );
+  }
+
+  {
+  WorkerPool pool( 4 );
+  pool.start();
+  const int nmiddle = 32, njoins = 8, nnodes = 1 + nmiddle + njoins + 1, nruns = 1000;
+  TaskGraph graph;
+  std::vector<std::vector<TaskGraph::Node>> preds;
+  std::vector<std::atomic<int>> runs( nnodes );
+  std::atomic<int> nran( 0 ), nearly( 0 );
+  int round = 0;
+  auto add = [&] () {
+    const TaskGraph::Node node = preds.size();
+    preds.emplace_back();
+    return graph.emplace( [&, node] () {
+                            for( TaskGraph::Node pred : preds[node] ) {
+                              if( runs[pred].load() != round ) {
+                                ++nearly;
+                              }
+                            }
+                            runs[node].store( round );
+                            ++nran;
+                          } );
+  };
+  auto precede = [&] ( TaskGraph::Node before_, TaskGraph::Node after_ ) {
+    graph.precede( before_, after_ );
+    preds[after_].push_back( before_ );
+  };
+  const TaskGraph::Node source = add();
+  std::vector<TaskGraph::Node> joins;
+  for( int j = 0; j < njoins; ++j ) {
+    joins.push_back( add() );
+  }
+  for( int j = 0; j < nmiddle; ++j ) {
+    const TaskGraph::Node middle = add();
+    precede( source, middle );
+    precede( middle, joins[j % njoins] );
+  }
+  const TaskGraph::Node sink = add();
+  for( TaskGraph::Node join : joins ) {
+    precede( join, sink );
+  }
+  const auto t0 = std::chrono::steady_clock::now();
+  for( round = 1; round <= nruns; ++round ) {
+    graph.run( pool );
+    graph.wait();
+  }
+  const auto t1 = std::chrono::steady_clock::now();
+  const double us = std::chrono::duration<double, std::micro>( t1 - t0 ).count() / nruns;
+  TaskGraph cycle;
+  const TaskGraph::Node a = cycle.emplace( [] () {} ), b = cycle.emplace( [] () {} );
+  cycle.precede( a, b );
+  cycle.precede( b, a );
+  bool rejected = false;
+  try {
+    cycle.run( pool );
+  } catch( const std::invalid_argument& ) {
+    rejected = true;
+  }
+  pool.stop();
+  LOG( "TaskGraph of " << graph.size() << " nodes ran " << nruns << " times: "
+       << ( nran == nnodes * nruns && !nearly && rejected ? "ok" : "FAILED" ) << ", " << nran
+       << " nodes run, " << nearly << " early, " << us << " us/run, cycle "
+       << ( rejected ? "rejected" : "accepted" ) );
+  }
+#endif
+
+  {
+  // two sockets, each a node with two cores of two SMT threads
+  const std::string root = "/tmp/znl_sysfs_" + std::to_string( ::getpid() );
+  ::mkdir( root.c_str(), 0700 );
+  write_file( root, "/cpu/online", "0-7" );
+  write_file( root, "/node/online", "0-1" );
+  write_file( root, "/node/node0/cpulist", "0-1,4-5" );
+  write_file( root, "/node/node1/cpulist", "2-3,6-7" );
+  for( int cpu = 0; cpu < 8; ++cpu ) {
+    const std::string dir = "/cpu/cpu" + std::to_string( cpu ) + "/topology/";
+    write_file( root, dir + "core_id", std::to_string( cpu % 4 ) );
+    write_file( root, dir + "physical_package_id", std::to_string( cpu % 4 / 2 ) );
+  }
+  const Topology fake( root );
+  std::system( ( "rm -rf " + root ).c_str() );
+  LOG( "Topology " << fake.cpus().size() << " CPUs on " << fake.node_count() << " nodes: compact"
+       << slot_cpus( Placement::compact( fake ) ) << ", scatter" << slot_cpus( Placement::scatter( fake ) )
+       << " (0 4 1 5 2 6 3 7, 0 2 1 3 4 6 5 7)" );
+
+  const Topology topology;
+  const Placement placement = Placement::scatter( topology );
+  Worker pinned( "Pinned", placement, placement.size() - 1 );
+  pinned.start();
+  std::promise<int> ran_on;
+  pinned.send( [&ran_on] () { ran_on.set_value( ::sched_getcpu() ); } );
+  LOG( "Worker placed on CPU " << pinned.cpu() << " of " << topology.cpus().size()
+       << " ran on CPU " << ran_on.get_future().get() );
+  pinned.stop();
+  }
+
   if( 0 )
   {
   Log.log( "Worker test" );
   Worker worker( "WorkerA" );
+  worker.set_placement( Placement::compact(), 0 );
   worker.start( [] ( std::thread& ) -> int {
-                  Log.log( "TODO: set thread affinity" );
+                  Log.log( "Worker thread prepared" );
                   return 0;
                 } );
   LOG( "Worker " << worker.name() << " started" );
@@ -138,7 +583,7 @@ int main()
   Actor actors[nactors];
   Log.log( "Actors created" );
   int ai, ti;
-  std::vector<Task> tasks;
+  std::vector<Func> tasks;
   //const int ntasks = 16;
   const int ntasks = 256;
   //const int ntasks = 1024;
@@ -146,18 +591,18 @@ int main()
   //const int ntasks = 16384;
   tasks.reserve( ntasks );
   for( ti = 0; ti < ntasks; ++ti ) {
-    tasks.emplace_back( Task( [ti] () {
+    tasks.emplace_back( [ti] () {
       LOG( "Running task " << ( ti + 1 ) );
       sleep( 1 );
       LOG( "Ran task " << ( ti + 1 ) );
-    } ) );
+    } );
   }
   Log.log( "Tasks created" );
   for( ti = 0; ti < ntasks/nactors; ++ti ) {
     for( ai = 0; ai < nactors; ++ai ) {
       int tiai = ( ti * nactors ) + ai;
       LOG( "Sending task" << ( tiai + 1 ) << " to actor" << ( ai + 1 ) );
-      actors[ai].send( tasks[tiai] );
+      actors[ai].send( std::move( tasks[tiai] ) );
     }
   }
   //sleep( 180 );
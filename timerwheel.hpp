@@ -0,0 +1,318 @@
+//  Hierarchical timing wheel for Worker::send_after() and send_every()
+//
+//  Copyright (C) 2018 Zoltan N. Leskowsky
+//
+//  Distributed under the Boost Software License, Version 1.0. (See
+//  accompanying file LICENSE_1_0.txt or copy at
+//  http://www.boost.org/LICENSE_1_0.txt)
+
+#ifndef ZNL_TIMER_WHEEL_HPP_INCLUDED
+#define ZNL_TIMER_WHEEL_HPP_INCLUDED
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+
+#include "taskqueue.hpp"
+
+#ifdef BOOST_HAS_PRAGMA_ONCE
+#pragma once
+#endif
+
+
+#if defined(_MSC_VER)
+#endif
+
+
+namespace znl {
+
+class Worker;
+
+namespace detail {
+
+struct TimerNode;
+class TimerPool;
+
+// A TimerNode goes to its Worker's timer queue twice at most: once to be
+// armed, and once more if cancelled.
+struct TimerLink : public SLinkable
+{
+  TimerNode* node;
+};
+
+// A timer and its Func, allocated by the sender from the Worker's pool. The
+// Worker and the Timer handle each hold a reference; whichever lets go second
+// returns the node, the Worker with the consumer-side deallocate().
+
+struct TimerNode
+{
+  TimerNode( Func&& func_, std::uint64_t deadline_ns_, std::uint64_t period_ns_, TimerPool& pool_ )
+    : func( std::move( func_ ) ), next( nullptr ), pprev( nullptr ), deadline_ns( deadline_ns_ ),
+      period_ns( period_ns_ ), expires( 0 ), slot( 0 ), refs( 2 ), cancelled( false ), pool( &pool_ ) {
+    arm.node = this;
+    cancel.node = this;
+  }
+  bool linked() const { return pprev != nullptr; }
+  // local_ on the Worker thread.
+  void release( bool local_ );
+
+  Func                       func;
+  TimerLink                  arm;
+  TimerLink                  cancel;
+  // the rest belongs to the Worker thread, but for refs and cancelled
+  TimerNode*                 next;
+  TimerNode**                pprev;
+  std::uint64_t              deadline_ns; // steady_clock
+  std::uint64_t              period_ns;   // 0 once only
+  std::uint64_t              expires;     // tick
+  unsigned                   slot;
+  std::atomic<std::uint32_t> refs;
+  std::atomic<bool>          cancelled;
+  TimerPool*                 pool;
+};
+
+class TimerPool : public NodePool<TimerNode> {};
+
+inline void TimerNode::release( bool local_ )
+{
+  if( refs.fetch_sub( 1, std::memory_order_acq_rel ) == 1 ) {
+    if( local_ ) {
+      pool->deallocate( this );
+    } else {
+      pool->deallocate_shared( this );
+    }
+  }
+}
+
+} //namespace detail
+
+// Timers of one thread in levels of 64 slots, after Varghese and Lauck's
+// hierarchical wheel as in the Linux kernel before 4.8: level l holds the
+// timers due in 64^l to 64^(l+1) ticks, by bits 6l to 6l+5 of their tick,
+// and a level's slot is cascaded down to the lower levels when the ticks
+// below it wrap. Adding and removing a timer are O(1), and a timer is moved
+// at most once per level. Four levels of 1 ms ticks reach about 4.6 hours;
+// later timers wait in the top level and are placed again when it comes
+// round.
+//
+// advance() jumps straight to the next tick with a timer or a cascade, found
+// from per-level bitmaps of non-empty slots, so an idle wheel costs nothing
+// per tick. Timers run on their tick or later, never earlier.
+
+class TimerWheel
+{
+  typedef detail::TimerNode Node;
+public:
+  static constexpr unsigned slot_bits = 6;
+  static constexpr unsigned slots = 1u << slot_bits;
+  static constexpr unsigned levels = 4;
+
+  explicit TimerWheel( std::uint64_t tick_ns_ = 1000000 )
+    : _tick_ns( tick_ns_ ? tick_ns_ : 1 ), _origin( now_ns() ), _now( 0 ), _size( 0 ) {
+    for( unsigned l = 0; l < levels; ++l ) {
+      _occupied[l] = 0;
+      for( unsigned s = 0; s < slots; ++s ) {
+        _slots[l][s] = nullptr;
+      }
+    }
+  }
+  TimerWheel( const TimerWheel& ) = delete;
+  TimerWheel& operator=( const TimerWheel& ) = delete;
+
+  static std::uint64_t now_ns() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+             std::chrono::steady_clock::now().time_since_epoch() ).count();
+  }
+  bool empty() const { return !_size; }
+  std::size_t size() const { return _size; }
+  // At node_.deadline_ns, or the next tick if that has passed.
+  void add( Node& node_ ) {
+    node_.expires = node_.deadline_ns > _origin ?
+                    ( node_.deadline_ns - _origin + _tick_ns - 1 ) / _tick_ns : 0;
+    place( node_ );
+    ++_size;
+  }
+  void remove( Node& node_ ) {
+    unlink( node_ );
+    --_size;
+  }
+  // Calls fire_( node ) for each timer due by now_ns_, removed first.
+  template<typename Fire>
+  void advance( std::uint64_t now_ns_, Fire&& fire_ ) {
+    const std::uint64_t target = now_ns_ > _origin ? ( now_ns_ - _origin ) / _tick_ns : 0;
+    std::uint64_t tick;
+    while( _size && ( tick = next_tick() ) <= target ) {
+      _now = tick;
+      for( unsigned l = 1; l < levels && !( tick & ( ( std::uint64_t( 1 ) << slot_bits * l ) - 1 ) ); ++l ) {
+        cascade( l, ( tick >> slot_bits * l ) & ( slots - 1 ) );
+      }
+      Node* node = detach( 0, tick & ( slots - 1 ) );
+      _now = tick + 1;
+      while( node ) {
+        Node* next = node->next;
+        node->pprev = nullptr;
+        --_size;
+        fire_( *node );
+        node = next;
+      }
+    }
+    if( target >= _now ) {
+      _now = target + 1;
+    }
+  }
+  // Until the next tick with a timer or a cascade: 0 if that is due, -1
+  // when empty.
+  std::int64_t timeout_ns( std::uint64_t now_ns_ ) const {
+    if( !_size ) {
+      return -1;
+    }
+    const std::uint64_t at = _origin + next_tick() * _tick_ns;
+    return at > now_ns_ ? static_cast<std::int64_t>( at - now_ns_ ) : 0;
+  }
+  // Removes every timer, calling f_( node ) on each.
+  template<typename F>
+  void clear( F&& f_ ) {
+    for( unsigned l = 0; l < levels; ++l ) {
+      for( unsigned s = 0; s < slots; ++s ) {
+        for( Node* node = detach( l, s ), *next; node; node = next ) {
+          next = node->next;
+          node->pprev = nullptr;
+          --_size;
+          f_( *node );
+        }
+      }
+    }
+  }
+
+private:
+  static unsigned first_set( std::uint64_t bits_ ) {
+#if defined(__GNUC__)
+    return __builtin_ctzll( bits_ );
+#else
+    unsigned i = 0;
+    for( ; !( bits_ & 1 ); bits_ >>= 1 ) {
+      ++i;
+    }
+    return i;
+#endif
+  }
+  static std::uint64_t rotate_right( std::uint64_t bits_, unsigned n_ ) {
+    return n_ ? bits_ >> n_ | bits_ << ( 64 - n_ ) : bits_;
+  }
+  void place( Node& node_ ) {
+    std::uint64_t expires = node_.expires < _now ? _now : node_.expires;
+    const std::uint64_t delta = expires - _now;
+    unsigned l = 0;
+    while( l + 1 < levels && delta >> slot_bits * ( l + 1 ) ) {
+      ++l;
+    }
+    if( delta >> slot_bits * levels ) {
+      expires = _now + ( std::uint64_t( 1 ) << slot_bits * levels ) - 1;
+    }
+    const unsigned s = ( expires >> slot_bits * l ) & ( slots - 1 );
+    Node*& head = _slots[l][s];
+    node_.slot = l * slots + s;
+    node_.next = head;
+    node_.pprev = &head;
+    if( head ) {
+      head->pprev = &node_.next;
+    }
+    head = &node_;
+    _occupied[l] |= std::uint64_t( 1 ) << s;
+  }
+  void unlink( Node& node_ ) {
+    *node_.pprev = node_.next;
+    if( node_.next ) {
+      node_.next->pprev = node_.pprev;
+    }
+    node_.pprev = nullptr;
+    const unsigned l = node_.slot / slots, s = node_.slot % slots;
+    if( !_slots[l][s] ) {
+      _occupied[l] &= ~( std::uint64_t( 1 ) << s );
+    }
+  }
+  Node* detach( unsigned l_, unsigned s_ ) {
+    Node* head = _slots[l_][s_];
+    _slots[l_][s_] = nullptr;
+    _occupied[l_] &= ~( std::uint64_t( 1 ) << s_ );
+    return head;
+  }
+  void cascade( unsigned l_, unsigned s_ ) {
+    for( Node* node = detach( l_, s_ ), *next; node; node = next ) {
+      next = node->next;
+      place( *node );
+    }
+  }
+  // The first tick from _now that fires level 0 or cascades a higher level.
+  std::uint64_t next_tick() const {
+    std::uint64_t best = UINT64_MAX;
+    if( _occupied[0] ) {
+      best = _now + first_set( rotate_right( _occupied[0], _now & ( slots - 1 ) ) );
+    }
+    for( unsigned l = 1; l < levels; ++l ) {
+      if( _occupied[l] ) {
+        const unsigned shift = slot_bits * l;
+        const std::uint64_t base = ( _now + ( std::uint64_t( 1 ) << shift ) - 1 ) >> shift;
+        const std::uint64_t tick =
+          ( base + first_set( rotate_right( _occupied[l], base & ( slots - 1 ) ) ) ) << shift;
+        best = tick < best ? tick : best;
+      }
+    }
+    return best;
+  }
+
+private:
+  const std::uint64_t _tick_ns;
+  const std::uint64_t _origin;
+  std::uint64_t       _now; // the next tick to run
+  std::size_t         _size;
+  std::uint64_t       _occupied[levels];
+  Node*               _slots[levels][slots];
+};
+
+// The result of Worker::send_after() and send_every(). Dropping it leaves the
+// timer running; cancel() stops it, though a run already under way on the
+// Worker completes. Move-only, and must not outlive its Worker.
+
+class Timer
+{
+public:
+  Timer() : _node( nullptr ), _worker( nullptr ) {}
+  Timer( Timer&& timer_ ) : _node( timer_._node ), _worker( timer_._worker ) {
+    timer_._node = nullptr;
+  }
+  Timer& operator=( Timer&& timer_ ) {
+    if( this != &timer_ ) {
+      reset();
+      _node = timer_._node;
+      _worker = timer_._worker;
+      timer_._node = nullptr;
+    }
+    return *this;
+  }
+  Timer( const Timer& ) = delete;
+  Timer& operator=( const Timer& ) = delete;
+  ~Timer() { reset(); }
+  bool valid() const { return _node != nullptr; }
+  // The Timer is then invalid.
+  void cancel(); // in worker.cpp
+
+private:
+  friend class Worker;
+  Timer( detail::TimerNode* node_, Worker* worker_ ) : _node( node_ ), _worker( worker_ ) {}
+  void reset() {
+    if( _node ) {
+      _node->release( false );
+      _node = nullptr;
+    }
+  }
+
+private:
+  detail::TimerNode* _node;
+  Worker*            _worker;
+};
+
+} //namespace znl
+
+#endif //ZNL_TIMER_WHEEL_HPP_INCLUDED
@@ -0,0 +1,212 @@
+//  CPU and NUMA topology, and Worker thread placement
+//
+//  Copyright (C) 2018 Zoltan N. Leskowsky
+//
+//  Distributed under the Boost Software License, Version 1.0. (See
+//  accompanying file LICENSE_1_0.txt or copy at
+//  http://www.boost.org/LICENSE_1_0.txt)
+
+#include <algorithm>
+#include <cerrno>
+#include <climits>
+#include <fstream>
+#include <sstream>
+#include <thread>
+#include <tuple>
+
+#if defined(__linux__)
+#include <linux/mempolicy.h>
+#include <sched.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#include "topology.hpp"
+
+namespace znl {
+
+// "0-3,8,10-11"
+static std::vector<int> parse_cpulist( const std::string& list_ )
+{
+  std::vector<int> ids;
+  std::stringstream ss( list_ );
+  std::string range;
+  while( std::getline( ss, range, ',' ) ) {
+    int first, last;
+    char dash;
+    std::stringstream rs( range );
+    if( !( rs >> first ) ) {
+      continue;
+    }
+    if( !( rs >> dash >> last ) || dash != '-' ) {
+      last = first;
+    }
+    for( int id = first; id <= last; ++id ) {
+      ids.push_back( id );
+    }
+  }
+  return ids;
+}
+
+static bool read_line( const std::string& path_, std::string& line_ )
+{
+  std::ifstream in( path_ );
+  return static_cast<bool>( std::getline( in, line_ ) );
+}
+
+static int read_int( const std::string& path_, int default_ )
+{
+  std::string line;
+  int value;
+  std::stringstream ss;
+  if( read_line( path_, line ) ) {
+    ss.str( line );
+    if( ss >> value ) {
+      return value;
+    }
+  }
+  return default_;
+}
+
+Topology::Topology( const std::string& sysfs_ ) : _nodes( 1 )
+{
+  std::string line;
+  std::vector<int> online;
+  if( read_line( sysfs_ + "/cpu/online", line ) ) {
+    online = parse_cpulist( line );
+  }
+  if( online.empty() ) {
+    const int n = std::max( 1u, std::thread::hardware_concurrency() );
+    for( int cpu = 0; cpu < n; ++cpu ) {
+      _cpus.push_back( CpuInfo{ cpu, cpu, 0, 0 } );
+    }
+    return;
+  }
+  for( int cpu : online ) {
+    std::stringstream dir;
+    dir << sysfs_ << "/cpu/cpu" << cpu << "/topology/";
+    _cpus.push_back( CpuInfo{ cpu, read_int( dir.str() + "core_id", cpu ),
+                              read_int( dir.str() + "physical_package_id", 0 ), 0 } );
+  }
+  if( read_line( sysfs_ + "/node/online", line ) ) {
+    const std::vector<int> nodes = parse_cpulist( line );
+    for( int node : nodes ) {
+      std::stringstream path;
+      path << sysfs_ << "/node/node" << node << "/cpulist";
+      if( !read_line( path.str(), line ) ) {
+        continue;
+      }
+      for( int cpu : parse_cpulist( line ) ) {
+        for( CpuInfo& info : _cpus ) {
+          if( info.cpu == cpu ) {
+            info.node = node;
+          }
+        }
+      }
+    }
+    if( !nodes.empty() ) {
+      _nodes = *std::max_element( nodes.begin(), nodes.end() ) + 1;
+    }
+  }
+}
+
+int Topology::node_of( int cpu_ ) const
+{
+  for( const CpuInfo& info : _cpus ) {
+    if( info.cpu == cpu_ ) {
+      return info.node;
+    }
+  }
+  return -1;
+}
+
+Placement Placement::compact( const Topology& topology_ )
+{
+  Placement placement;
+  placement._slots = topology_.cpus();
+  std::sort( placement._slots.begin(), placement._slots.end(),
+             [] ( const CpuInfo& a_, const CpuInfo& b_ ) {
+               return std::tie( a_.node, a_.package, a_.core, a_.cpu ) <
+                      std::tie( b_.node, b_.package, b_.core, b_.cpu );
+             } );
+  return placement;
+}
+
+Placement Placement::scatter( const Topology& topology_ )
+{
+  // Per node: the first SMT thread of each core, then the second, ...
+  std::vector<std::vector<std::pair<int, CpuInfo>>> nodes( topology_.node_count() );
+  std::vector<CpuInfo> cpus = compact( topology_ )._slots;
+  for( std::size_t i = 0; i < cpus.size(); ++i ) {
+    int sibling = 0;
+    for( std::size_t j = i; j > 0 && cpus[j - 1].node == cpus[i].node &&
+                            cpus[j - 1].package == cpus[i].package &&
+                            cpus[j - 1].core == cpus[i].core; --j ) {
+      ++sibling;
+    }
+    nodes[cpus[i].node].push_back( std::make_pair( sibling, cpus[i] ) );
+  }
+  for( auto& node : nodes ) {
+    std::stable_sort( node.begin(), node.end(),
+                      [] ( const std::pair<int, CpuInfo>& a_, const std::pair<int, CpuInfo>& b_ ) {
+                        return a_.first < b_.first;
+                      } );
+  }
+  Placement placement;
+  for( std::size_t round = 0; placement._slots.size() < cpus.size(); ++round ) {
+    for( auto& node : nodes ) {
+      if( round < node.size() ) {
+        placement._slots.push_back( node[round].second );
+      }
+    }
+  }
+  return placement;
+}
+
+Placement Placement::cpus( const std::vector<int>& cpus_, const Topology& topology_ )
+{
+  Placement placement;
+  for( int cpu : cpus_ ) {
+    placement._slots.push_back( CpuInfo{ cpu, -1, -1, topology_.node_of( cpu ) } );
+  }
+  return placement;
+}
+
+#if defined(__linux__)
+int pin_current_thread( int cpu_ )
+{
+  if( cpu_ < 0 || cpu_ >= CPU_SETSIZE ) {
+    return EINVAL;
+  }
+  cpu_set_t set;
+  CPU_ZERO( &set );
+  CPU_SET( cpu_, &set );
+  return ::sched_setaffinity( 0, sizeof( set ), &set ) == 0 ? 0 : errno;
+}
+
+int prefer_node_memory( int node_ )
+{
+  if( node_ < 0 ) {
+    return EINVAL;
+  }
+  constexpr std::size_t bits = sizeof( unsigned long ) * CHAR_BIT;
+  std::vector<unsigned long> mask( node_ / bits + 1, 0 );
+  mask[node_ / bits] = 1ul << ( node_ % bits );
+  // the kernel reads maxnode - 1 bits
+  return ::syscall( SYS_set_mempolicy, MPOL_PREFERRED, mask.data(), mask.size() * bits + 1 ) == 0 ?
+         0 : errno;
+}
+
+#else
+int pin_current_thread( int )
+{
+  return ENOSYS;
+}
+
+int prefer_node_memory( int )
+{
+  return ENOSYS;
+}
+#endif
+
+} //namespace znl
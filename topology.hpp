@@ -0,0 +1,91 @@
+//  CPU and NUMA topology, and Worker thread placement
+//
+//  Copyright (C) 2018 Zoltan N. Leskowsky
+//
+//  Distributed under the Boost Software License, Version 1.0. (See
+//  accompanying file LICENSE_1_0.txt or copy at
+//  http://www.boost.org/LICENSE_1_0.txt)
+
+#ifndef ZNL_TOPOLOGY_HPP_INCLUDED
+#define ZNL_TOPOLOGY_HPP_INCLUDED
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+#ifdef BOOST_HAS_PRAGMA_ONCE
+#pragma once
+#endif
+
+
+#if defined(_MSC_VER)
+#endif
+
+
+namespace znl {
+
+struct CpuInfo
+{
+  int cpu;
+  int core;    // core_id, unique within the package
+  int package; // physical_package_id, i.e. socket
+  int node;    // NUMA node
+};
+
+// The online CPUs, read from /sys/devices/system/cpu and
+// /sys/devices/system/node. Where these are missing, as off Linux, there is
+// one node with hardware_concurrency() CPUs, each its own core.
+
+class Topology
+{
+public:
+  explicit Topology( const std::string& sysfs_ = "/sys/devices/system" );
+  const std::vector<CpuInfo>& cpus() const { return _cpus; }
+  std::size_t node_count() const { return _nodes; }
+  // -1 for a CPU that is not online.
+  int node_of( int cpu_ ) const;
+
+private:
+  std::vector<CpuInfo> _cpus; // by CPU number
+  std::size_t          _nodes;
+};
+
+// Which CPU, and so which NUMA node, the i-th Worker of a set runs on. Slots
+// are reused modulo size() when there are more Workers than CPUs.
+//
+//   compact: fills a core, then a package, then a node before the next, so
+//            that Workers that talk to each other share caches
+//   scatter: one Worker per node in turn, and distinct cores before SMT
+//            siblings, for the most memory bandwidth and cache per Worker
+//   cpus:    the listed CPUs, in order
+//
+// A default Placement leaves threads to the scheduler.
+
+class Placement
+{
+public:
+  Placement() {}
+  static Placement compact( const Topology& topology_ = Topology() );
+  static Placement scatter( const Topology& topology_ = Topology() );
+  static Placement cpus( const std::vector<int>& cpus_, const Topology& topology_ = Topology() );
+  std::size_t size() const { return _slots.size(); }
+  // -1 when unpinned, or for node() when the CPU is not online.
+  int cpu( std::size_t index_ ) const {
+    return _slots.empty() ? -1 : _slots[index_ % _slots.size()].cpu;
+  }
+  int node( std::size_t index_ ) const {
+    return _slots.empty() ? -1 : _slots[index_ % _slots.size()].node;
+  }
+
+private:
+  std::vector<CpuInfo> _slots;
+};
+
+// For the calling thread; 0 or an errno value, ENOSYS off Linux.
+int pin_current_thread( int cpu_ );
+// Prefers node_'s memory for the pages the calling thread touches first.
+int prefer_node_memory( int node_ );
+
+} //namespace znl
+
+#endif //ZNL_TOPOLOGY_HPP_INCLUDED
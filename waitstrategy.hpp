@@ -0,0 +1,353 @@
+//  Wait strategies for queue consumers: busy-spin, spin-then-yield,
+//  spin-then-futex and eventfd, and an adaptive spin window
+//
+//  Copyright (C) 2018 Zoltan N. Leskowsky
+//
+//  Distributed under the Boost Software License, Version 1.0. (See
+//  accompanying file LICENSE_1_0.txt or copy at
+//  http://www.boost.org/LICENSE_1_0.txt)
+
+#ifndef ZNL_WAIT_STRATEGY_HPP_INCLUDED
+#define ZNL_WAIT_STRATEGY_HPP_INCLUDED
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstdint>
+#include <system_error>
+#include <thread>
+
+#if defined(__linux__)
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <time.h>
+#include <unistd.h>
+#endif
+
+#include "eventcount.hpp"
+#include "mpscqueue.hpp"
+
+#ifdef BOOST_HAS_PRAGMA_ONCE
+#pragma once
+#endif
+
+
+#if defined(_MSC_VER)
+#endif
+
+
+namespace znl {
+
+// A wait strategy decides what a consumer does while its queue is empty,
+// trading CPU for wakeup latency. All strategies share one interface:
+//
+//   Wait::Backoff                // waiting_pop<Wait::Backoff>() waits out a
+//                                // push in process with it
+//   wait.wait( ready );          // consumer: returns once ready() is true
+//   wait.wait_for( ready, ns );  // or false once ns have passed
+//   wait.notify();               // producer: after each push
+//
+// ready() is typically an attempt to pop, so it may run any number of times.
+// The parking strategies count their sleepers, so notify() costs a fence and
+// a load while nobody sleeps.
+
+namespace detail {
+
+class SpinBackoff
+{
+public:
+  void operator()() { cpu_relax(); }
+};
+
+} //namespace detail
+
+// Never gives up the CPU: lowest latency, one core per consumer.
+class BusySpinWait
+{
+public:
+  typedef detail::SpinBackoff Backoff;
+
+  template<typename Ready>
+  void wait( Ready&& ready_ ) {
+    while( !ready_() ) {
+      detail::cpu_relax();
+    }
+  }
+  template<typename Ready>
+  bool wait_for( Ready&& ready_, std::chrono::nanoseconds timeout_ ) {
+    const std::chrono::steady_clock::time_point until = std::chrono::steady_clock::now() + timeout_;
+    while( !ready_() ) {
+      if( std::chrono::steady_clock::now() >= until ) {
+        return false;
+      }
+      detail::cpu_relax();
+    }
+    return true;
+  }
+  void notify() {}
+};
+
+// Spins Spins times, then yields between attempts: the consumer stays
+// runnable, so an idle one still costs scheduler time.
+template<unsigned Spins = 128>
+class SpinYieldWait
+{
+public:
+  typedef detail::SpinYieldBackoff<Spins> Backoff;
+
+  template<typename Ready>
+  void wait( Ready&& ready_ ) {
+    Backoff backoff;
+    while( !ready_() ) {
+      backoff();
+    }
+  }
+  template<typename Ready>
+  bool wait_for( Ready&& ready_, std::chrono::nanoseconds timeout_ ) {
+    const std::chrono::steady_clock::time_point until = std::chrono::steady_clock::now() + timeout_;
+    Backoff backoff;
+    while( !ready_() ) {
+      if( std::chrono::steady_clock::now() >= until ) {
+        return false;
+      }
+      backoff();
+    }
+    return true;
+  }
+  void notify() {}
+};
+
+// Spins Spins times, then sleeps on an EventCount until notified.
+template<unsigned Spins = 128>
+class SpinFutexWait
+{
+public:
+  typedef detail::SpinYieldBackoff<> Backoff;
+
+  template<typename Ready>
+  void wait( Ready&& ready_ ) {
+    for( unsigned i = 0; i < Spins; ++i ) {
+      if( ready_() ) {
+        return;
+      }
+      detail::cpu_relax();
+    }
+    for( ;; ) {
+      const EventCount::Key key = _eventcount.prepare_wait();
+      if( ready_() ) {
+        _eventcount.cancel_wait();
+        return;
+      }
+      _eventcount.commit_wait( key );
+    }
+  }
+  template<typename Ready>
+  bool wait_for( Ready&& ready_, std::chrono::nanoseconds timeout_ ) {
+    for( unsigned i = 0; i < Spins; ++i ) {
+      if( ready_() ) {
+        return true;
+      }
+      detail::cpu_relax();
+    }
+    const std::chrono::steady_clock::time_point until = std::chrono::steady_clock::now() + timeout_;
+    for( ;; ) {
+      const EventCount::Key key = _eventcount.prepare_wait();
+      if( ready_() ) {
+        _eventcount.cancel_wait();
+        return true;
+      }
+      // commit_wait_for() ends the wait even when no time is left
+      if( !_eventcount.commit_wait_for( key, until - std::chrono::steady_clock::now() ) ) {
+        return ready_();
+      }
+    }
+  }
+  void notify() { _eventcount.notify(); }
+private:
+  EventCount _eventcount;
+};
+
+// How long an idle consumer spins before it parks, after the Linux haltpoll
+// cpuidle governor: the window grows from MinNs, doubling, each time the
+// consumer parked and was woken within MaxNs, which a longer spin would have
+// caught, and halves, down to 0, each time it stayed parked longer. With
+// gaps of a few microseconds the consumer ends up spinning about one gap and
+// skips the park and wake; an idle one soon stops spinning.
+//
+//   if( !spin.spin( ready ) ) {
+//     ... park until ready() ...
+//     spin.parked();
+//   }
+//
+// Off with one hardware thread, where spinning only delays the producer.
+// spins() and parks() count the idle periods each way; they may be read by
+// any thread.
+
+template<std::uint32_t MinNs = 1000, std::uint32_t MaxNs = 50000>
+class AdaptiveSpin
+{
+  static_assert( MinNs <= MaxNs, "MinNs must not exceed MaxNs; 0, 0 never spins" );
+  typedef std::chrono::steady_clock Clock;
+public:
+  explicit AdaptiveSpin( bool enabled_ = std::thread::hardware_concurrency() > 1 )
+    : _enabled( enabled_ ), _window( 0 ), _spins( 0 ), _parks( 0 ) {}
+
+  // Tries ready_() for up to the window; false if the caller should park.
+  template<typename Ready>
+  bool spin( Ready&& ready_ ) {
+    _start = Clock::now();
+    if( _window ) {
+      const Clock::time_point until = _start + std::chrono::nanoseconds( _window );
+      do {
+        for( unsigned i = 0; i < 16; ++i ) {
+          if( ready_() ) {
+            _spins.store( _spins.load( std::memory_order_relaxed ) + 1, std::memory_order_relaxed );
+            return true;
+          }
+          detail::cpu_relax();
+        }
+      } while( Clock::now() < until );
+    }
+    return false;
+  }
+  // After the park that followed a failed spin().
+  void parked() {
+    const std::chrono::nanoseconds idle = Clock::now() - _start;
+    if( _enabled && idle.count() <= static_cast<std::int64_t>( MaxNs ) ) {
+      _window = _window ? std::min( 2 * _window, MaxNs ) : MinNs;
+    } else {
+      _window = _window / 2 < MinNs ? 0 : _window / 2;
+    }
+    _parks.store( _parks.load( std::memory_order_relaxed ) + 1, std::memory_order_relaxed );
+  }
+  std::uint32_t window_ns() const { return _window; }
+  std::uint64_t spins() const { return _spins.load( std::memory_order_relaxed ); }
+  std::uint64_t parks() const { return _parks.load( std::memory_order_relaxed ); }
+
+private:
+  const bool                 _enabled;
+  std::uint32_t              _window;
+  Clock::time_point          _start;
+  std::atomic<std::uint64_t> _spins; // consumer-written
+  std::atomic<std::uint64_t> _parks;
+};
+
+#if defined(__linux__)
+namespace detail {
+
+// Parks in read() on an eventfd, which may also be polled with
+// native_handle(); a wakeup not consumed is seen by the next park().
+class EventfdParker
+{
+public:
+  EventfdParker() : _fd( ::eventfd( 0, EFD_CLOEXEC ) ) {
+    if( _fd < 0 ) {
+      throw std::system_error( errno, std::system_category(), "eventfd" );
+    }
+  }
+  EventfdParker( const EventfdParker& ) = delete;
+  EventfdParker& operator=( const EventfdParker& ) = delete;
+  ~EventfdParker() { ::close( _fd ); }
+  int native_handle() const { return _fd; }
+  int prepare() { return 0; }
+  void park( int ) {
+    std::uint64_t n;
+    while( ::read( _fd, &n, sizeof( n ) ) < 0 && errno == EINTR ) ;
+  }
+  void park_for( int token_, std::chrono::nanoseconds timeout_ ) {
+    struct pollfd pfd = { _fd, POLLIN, 0 };
+    struct timespec ts;
+    ts.tv_sec = static_cast<time_t>( timeout_.count() / 1000000000 );
+    ts.tv_nsec = static_cast<long>( timeout_.count() % 1000000000 );
+    if( ::ppoll( &pfd, 1, &ts, nullptr ) > 0 ) {
+      park( token_ );
+    }
+  }
+  void unpark() {
+    const std::uint64_t one = 1;
+    while( ::write( _fd, &one, sizeof( one ) ) < 0 && errno == EINTR ) ;
+  }
+private:
+  int _fd;
+};
+
+} //namespace detail
+
+// Spins Spins times, then sleeps in Parker until notified, with the same
+// handshake as EventCount.
+template<typename Parker, unsigned Spins>
+class ParkingWait
+{
+public:
+  typedef detail::SpinYieldBackoff<> Backoff;
+
+  ParkingWait() : _sleepers( 0 ) {}
+  ParkingWait( const ParkingWait& ) = delete;
+  ParkingWait& operator=( const ParkingWait& ) = delete;
+  template<typename Ready>
+  void wait( Ready&& ready_ ) {
+    for( unsigned i = 0; i < Spins; ++i ) {
+      if( ready_() ) {
+        return;
+      }
+      detail::cpu_relax();
+    }
+    for( ;; ) {
+      const auto token = _parker.prepare();
+      _sleepers.fetch_add( 1, std::memory_order_relaxed );
+      std::atomic_thread_fence( std::memory_order_seq_cst );
+      if( ready_() ) {
+        _sleepers.fetch_sub( 1, std::memory_order_relaxed );
+        return;
+      }
+      _parker.park( token );
+      _sleepers.fetch_sub( 1, std::memory_order_relaxed );
+    }
+  }
+  template<typename Ready>
+  bool wait_for( Ready&& ready_, std::chrono::nanoseconds timeout_ ) {
+    for( unsigned i = 0; i < Spins; ++i ) {
+      if( ready_() ) {
+        return true;
+      }
+      detail::cpu_relax();
+    }
+    const std::chrono::steady_clock::time_point until = std::chrono::steady_clock::now() + timeout_;
+    for( ;; ) {
+      const auto token = _parker.prepare();
+      _sleepers.fetch_add( 1, std::memory_order_relaxed );
+      std::atomic_thread_fence( std::memory_order_seq_cst );
+      const std::chrono::nanoseconds left = until - std::chrono::steady_clock::now();
+      if( ready_() ) {
+        _sleepers.fetch_sub( 1, std::memory_order_relaxed );
+        return true;
+      }
+      if( left.count() <= 0 ) {
+        _sleepers.fetch_sub( 1, std::memory_order_relaxed );
+        return false;
+      }
+      _parker.park_for( token, left );
+      _sleepers.fetch_sub( 1, std::memory_order_relaxed );
+    }
+  }
+  void notify() {
+    std::atomic_thread_fence( std::memory_order_seq_cst );
+    if( _sleepers.load( std::memory_order_relaxed ) ) {
+      _parker.unpark();
+    }
+  }
+  Parker& parker() { return _parker; }
+private:
+  Parker                _parker;
+  std::atomic<unsigned> _sleepers;
+};
+
+// Blocks at once by default; parker().native_handle() is pollable.
+template<unsigned Spins = 0>
+using EventfdWait = ParkingWait<detail::EventfdParker, Spins>;
+#endif
+
+} //namespace znl
+
+#endif //ZNL_WAIT_STRATEGY_HPP_INCLUDED
@@ -9,6 +9,9 @@
 #include <iostream>
 #include <unistd.h>
 #include "worker.hpp"
+#ifndef ZNL_WORKER_SPSC
+#include "workerpool.hpp"
+#endif
 #include "logger.hpp"
 
 namespace znl {
@@ -16,11 +19,15 @@ namespace znl {
 //#define DEBUG( MSG ) std::cerr << "DEBUG: " << MSG << std::endl;
 #define DEBUG( MSG ) LOG( "DEBUG: " << MSG );
 
+#ifdef ZNL_MULTIUSE_FUTURE
 static void renew_promise( std::promise<void>& p_ )
 {
   p_.~promise<void>();
   ( void ) new ( &p_ ) std::promise<void>();
 }
+#endif
+
+constexpr std::size_t Worker::Batcher::capacity;
 
 Worker::~Worker()
 {
@@ -59,27 +66,181 @@ void Worker::start( std::function<int( std::thread& )>&& prepare_ )
   _ready.set_value();
 }
 
+void Worker::send( const Task& task_, unsigned priority_ )
+{
+  WorkerMetrics::stamp( task_, WorkerMetrics::now() );
+  _metrics.sent();
+  _push( task_, priority_ );
+  _wake( 1 );
+}
+
+Timer Worker::_send_timer( std::uint64_t delay_ns_, std::uint64_t period_ns_, Func&& func_ )
+{
+  detail::TimerNode* node = _timerpool.allocate( std::move( func_ ), TimerWheel::now_ns() + delay_ns_,
+                                                 period_ns_, _timerpool );
+  _timerqueue.push( node->arm );
+  _wake( 1 );
+  return Timer( node, this );
+}
+
+void Timer::cancel()
+{
+  if( !_node ) {
+    return;
+  }
+  // the Worker skips a due run at once, and unlinks the timer once it sees
+  // the cancel link, which carries this handle's reference
+  _node->cancelled.store( true, std::memory_order_release );
+  _worker->_timerqueue.push( _node->cancel );
+  _worker->_wake( 1 );
+  _node = nullptr;
+}
+
+std::size_t Worker::_take_timers()
+{
+  std::size_t n = 0;
+  while( const detail::TimerLink* link = _timerqueue.pop() ) {
+    detail::TimerNode& node = *link->node;
+    if( link == &node.arm ) {
+      if( node.cancelled.load( std::memory_order_acquire ) ) {
+        node.release( true );
+      } else {
+        _timers.add( node );
+      }
+    } else {
+      // after the arm link, which was pushed before the Timer existed
+      if( node.linked() ) {
+        _timers.remove( node );
+        node.release( true );
+      }
+      node.release( true );
+    }
+    ++n;
+  }
+  return n;
+}
+
+void Worker::_run_timers()
+{
+  const std::uint64_t now = TimerWheel::now_ns();
+  _timers.advance( now, [this, now] ( detail::TimerNode& node_ ) {
+                     if( !node_.cancelled.load( std::memory_order_acquire ) ) {
+                       node_.func();
+                     }
+                     if( !node_.period_ns || node_.cancelled.load( std::memory_order_acquire ) ) {
+                       node_.release( true );
+                       return;
+                     }
+                     node_.deadline_ns += node_.period_ns;
+                     if( node_.deadline_ns <= now ) {
+                       node_.deadline_ns += ( now - node_.deadline_ns ) / node_.period_ns * node_.period_ns +
+                                            node_.period_ns;
+                     }
+                     _timers.add( node_ );
+                   } );
+}
+
+const Task* Worker::_poll()
+{
+  if( const std::size_t n = _take_timers() ) {
+#ifdef ZNL_MULTIUSE_FUTURE
+    _count -= static_cast<int>( n ) - 1; // one per message was added, _pop() takes one
+#else
+    ( void ) n;
+#endif
+    return &_tick;
+  }
+#ifdef ZNL_WORKER_WAIT
+  return _taskqueue.waiting_pop<WorkerWait::Backoff>();
+#else
+  return _taskqueue.waiting_pop();
+#endif
+}
+
+void Worker::_wake( int n_ )
+{
+#ifndef ZNL_WORKER_SPSC
+  if( _pool ) {
+    _pool->wake( _index );
+    return;
+  }
+#endif
+  _notify( n_ );
+}
+
 void Worker::_run()
 {
   DEBUG( "Worker " << name() << " _run()" );
+#ifndef ZNL_WORKER_SPSC
+  if( _pool ) {
+    WorkerPool::set_current( this );
+  }
+#endif
+  if( _cpu >= 0 ) {
+    const int err = pin_current_thread( _cpu );
+    if( err ) {
+      DEBUG( "Worker " << name() << " not pinned to CPU " << _cpu << ": error " << err );
+    }
+  }
+  if( _node >= 0 ) {
+    // the default policy already places first touches locally once pinned
+    ( void ) prefer_node_memory( _node );
+    _taskpool.reserve( ZNL_WORKER_RESERVE );
+  }
+  _metrics.begin();
   for( ;; ) {
+    if( !_timers.empty() ) {
+      _run_timers();
+    }
     DEBUG( "Worker " << name() << " popping" );
+    Worker* owner = this;
+#ifdef ZNL_WORKER_SPSC
     const Task& task = _pop();
+#else
+    const Task& task = _pool ? _pool->pop( *this, owner ) : _pop();
+#endif
     DEBUG( "Worker " << name() << " popped" );
+    if( &task == &_tick ) {
+      continue;
+    }
+    if( !_pool ) {
+      _metrics.taken(); // a pool member counts in WorkerPool::drain()
+    }
     if( &task == &_stop ) {
       DEBUG( "Worker " << name() << " stopping" );
       break;
     }
+    // a submit() Task may be freed by its Future once it has run
+    const bool pooled = task.is_pooled();
+    _metrics.started( task );
     task();
+    if( pooled ) {
+      if( owner == this ) {
+        _taskpool.deallocate( const_cast<Task*>( &task ) );
+      } else {
+        // stolen: only the owner may deallocate into its TaskPool
+        *const_cast<Task*>( &task ) = Func();
+        owner->_push( task, 0 );
+      }
+    }
+    _metrics.finished();
   }
+  // pending timers are dropped; their Timers stay valid to cancel or destroy
+  _take_timers();
+  _timers.clear( [] ( detail::TimerNode& node_ ) { node_.release( true ); } );
   DEBUG( "Worker " << name() << " stopped" );
 }
 
-#ifdef ZNL_MULTIUSE_FUTURE
-void Worker::send( const Task& task_ )
+#if defined(ZNL_WORKER_WAIT)
+void Worker::_notify( int )
 {
-  _taskqueue.push( task_ );
-  if( 0 == _count++ ) {
+  _wait.notify();
+}
+
+#elif defined(ZNL_MULTIUSE_FUTURE)
+void Worker::_notify( int n_ )
+{
+  if( 0 == _count.fetch_add( n_ ) ) {
     AtomicLockGuard lk( _lock );
     if( _waiting ) {
       _ready.set_value();
@@ -88,32 +249,51 @@ void Worker::send( const Task& task_ )
   }
 }
 
-#else //!ZNL_MULTIUSE_FUTURE
-void Worker::send( const Task& task_ )
+#elif defined(ZNL_WORKER_CONDVAR)
+void Worker::_notify( int )
 {
-  _taskqueue.push( task_ );
-  if( 0 == _count++ ) {
+  std::atomic_thread_fence( std::memory_order_seq_cst );
+  if( _waiting.load( std::memory_order_relaxed ) ) {
     {
-      std::lock_guard<std::mutex> lk( _mutex ); // needed?
-      if( !_waiting ) {
-        return;
-      }
+      std::lock_guard<std::mutex> lk( _mutex ); // _pop() is in wait() or before its check
     }
     _condvar.notify_one();
-    _waiting = false;
   }
 }
+
+#else //ZNL_WORKER_EVENTCOUNT
+void Worker::_notify( int )
+{
+  _eventcount.notify();
+}
 #endif
 
-#ifdef ZNL_MULTIUSE_FUTURE
+#if defined(ZNL_WORKER_WAIT)
+const Task& Worker::_pop()
+{
+  const Task *ptask;
+  auto pop = [this, &ptask] () { return ( ptask = _poll() ) != nullptr; };
+  const std::int64_t timeout = _timeout();
+  if( timeout < 0 ) {
+    _wait.wait( pop );
+  } else if( !_wait.wait_for( pop, std::chrono::nanoseconds( timeout ) ) ) {
+    return _tick; // a timer is due
+  }
+  return *ptask;
+}
+
+#elif defined(ZNL_MULTIUSE_FUTURE)
 const Task& Worker::_pop()
 {
   const Task *ptask;
   int count = _count--; //TODO
   DEBUG( "Worker " << name() << count << " tasks queued" );
-  while( ( ptask = _taskqueue.pop() ) == nullptr ) {
+  while( ( ptask = _poll() ) == nullptr ) {
     DEBUG( "Worker " << name() << " popped null task" );
     if( 0 == count ) {
+      if( _spin.spin( [this, &ptask] () { return ( ptask = _poll() ) != nullptr; } ) ) {
+        break;
+      }
       ++_count; //TODO
       bool wait;
       {
@@ -122,8 +302,21 @@ const Task& Worker::_pop()
       }
       if( wait ) {
         DEBUG( "Worker " << name() << " waiting for push" );
-        _ready.get_future().wait();
+        const std::int64_t timeout = _timeout();
+        std::future<void> ready = _ready.get_future();
+        if( timeout < 0 ) {
+          ready.wait();
+        } else if( ready.wait_for( std::chrono::nanoseconds( timeout ) ) == std::future_status::timeout ) {
+          AtomicLockGuard lk( _lock );
+          if( _waiting ) { // no push meanwhile: a timer is due, and _count is as on entry
+            _waiting = false;
+            renew_promise( _ready );
+            return _tick;
+          }
+        }
         renew_promise( _ready );
+        _metrics.woken();
+        _spin.parked();
       }
       count = _count--; //TODO
     }
@@ -131,31 +324,61 @@ const Task& Worker::_pop()
   return *ptask;
 }
 
-#else //!ZNL_MULTIUSE_FUTURE
+#elif defined(ZNL_WORKER_CONDVAR)
 const Task& Worker::_pop()
 {
   DEBUG( "Worker " << name() << " _pop()" );
   const Task *ptask;
-  int count = _count--; //TODO
-  while( ( ptask = _taskqueue.pop() ) == nullptr ) {
+  auto pop = [this, &ptask] () { return ( ptask = _poll() ) != nullptr; };
+  if( !pop() && !_spin.spin( pop ) ) {
     DEBUG( "Worker " << name() << " _pop() popped null task" );
-    if( 0 == count ) {
-      ++_count; //TODO
-      std::unique_lock<std::mutex> lk( _mutex );
-      _waiting = true;
-      if( 0 == _count.load() ) {
-        //DEBUG( "Worker " << name() << " waiting for condvar" );
-        _condvar.wait( lk, [&ptask, this] () {
-                             return ( ptask = _taskqueue.pop() );
-                           } );
-        break;
-      }
-      _waiting = false;
+    std::unique_lock<std::mutex> lk( _mutex );
+    _waiting.store( true, std::memory_order_relaxed );
+    std::atomic_thread_fence( std::memory_order_seq_cst );
+    const std::int64_t timeout = _timeout();
+    bool popped = true;
+    if( timeout < 0 ) {
+      _condvar.wait( lk, pop );
+    } else {
+      popped = _condvar.wait_for( lk, std::chrono::nanoseconds( timeout ), pop );
+    }
+    _waiting.store( false, std::memory_order_relaxed );
+    if( !popped ) {
+      return _tick; // a timer is due
     }
+    _metrics.woken();
+    _spin.parked();
   }
   DEBUG( "Worker " << name() << " _pop() returning task" );
   return *ptask;
 }
+
+#else //ZNL_WORKER_EVENTCOUNT
+const Task& Worker::_pop()
+{
+  const Task *ptask;
+  auto pop = [this, &ptask] () { return ( ptask = _poll() ) != nullptr; };
+  if( pop() || _spin.spin( pop ) ) {
+    return *ptask;
+  }
+  do {
+    const EventCount::Key key = _eventcount.prepare_wait();
+    if( pop() ) {
+      _eventcount.cancel_wait();
+      break;
+    }
+    DEBUG( "Worker " << name() << " waiting for push" );
+    const std::int64_t timeout = _timeout();
+    if( timeout < 0 ) {
+      _eventcount.commit_wait( key );
+    } else if( !_eventcount.commit_wait_for( key, std::chrono::nanoseconds( timeout ) ) ) {
+      return _tick; // a timer is due
+    }
+    _metrics.woken();
+  } while( !pop() );
+  _spin.parked();
+  return *ptask;
+}
 #endif
 
 } //namespace znl
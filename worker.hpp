@@ -9,21 +9,49 @@
 #ifndef ZNL_WORKER_HPP_INCLUDED
 #define ZNL_WORKER_HPP_INCLUDED
 
-#define ZNL_MULTIUSE_FUTURE
+//#define ZNL_MULTIUSE_FUTURE // promise wakeup, renewed after each wait
+//#define ZNL_WORKER_CONDVAR // condition_variable wakeup
+//#define ZNL_WORKER_BOUNDED 1024 // mailbox capacity
+//#define ZNL_WORKER_SPSC // a single thread sends to the Worker
+//#define ZNL_WORKER_PRIORITIES 4 // priority lanes for send( task, priority )
+//#define ZNL_WORKER_SHARDS 16 // per-sender sub-queues for many sending threads
+//#define ZNL_WORKER_WAIT SpinFutexWait<> // wait strategy in place of the promise
+//#define ZNL_WORKER_RESERVE 256 // Tasks carved on a placed Worker's NUMA node
+//#define ZNL_WORKER_SPIN_MAX_NS 50000 // adaptive spin before parking; 0 parks at once
+//#define ZNL_WORKER_METRICS // counters and histograms for stats(), see workermetrics.hpp
+//#define ZNL_WORKER_TIMER_TICK_NS 1000000 // resolution of send_after() and send_every()
 
 #include <atomic>
+#include <chrono>
 #include <future>
-#ifndef ZNL_MULTIUSE_FUTURE
+#ifdef ZNL_WORKER_CONDVAR
 #include <condition_variable>
 #include <mutex>
 #endif
 #include <thread>
 
-#ifdef ZNL_MULTIUSE_FUTURE
+#if defined(ZNL_MULTIUSE_FUTURE)
 #include "atomiclock.hpp"
+#elif !defined(ZNL_WORKER_WAIT) && !defined(ZNL_WORKER_CONDVAR)
+#include "eventcount.hpp"
+#define ZNL_WORKER_EVENTCOUNT
 #endif
 
+#include "future.hpp"
 #include "taskqueue.hpp"
+#include "timerwheel.hpp"
+#include "topology.hpp"
+#if defined(ZNL_WORKER_BOUNDED)
+#include "boundedmpscqueue.hpp"
+#elif defined(ZNL_WORKER_SPSC)
+#include "spscqueue.hpp"
+#elif defined(ZNL_WORKER_PRIORITIES)
+#include "priorityqueue.hpp"
+#elif defined(ZNL_WORKER_SHARDS)
+#include "shardedqueue.hpp"
+#endif
+#include "waitstrategy.hpp"
+#include "workermetrics.hpp"
 
 #ifdef BOOST_HAS_PRAGMA_ONCE
 #pragma once
@@ -36,26 +64,153 @@
 
 namespace znl {
 
+#if defined(ZNL_WORKER_BOUNDED)
+// send() waits while the mailbox is full, so a task must not send more than
+// the capacity to its own Worker.
+using WorkerQueue = TaskPtrQueue<BoundedMPSCQueue<const Task*, ZNL_WORKER_BOUNDED>>;
+#elif defined(ZNL_WORKER_SPSC)
+// Including send_stop(): all sends must come from one thread at a time.
+using WorkerQueue = TaskPtrQueue<SPSCQueue<const Task*>>;
+#elif defined(ZNL_WORKER_PRIORITIES)
+using WorkerQueue = PriorityMPSCIntrQueue<Task, ZNL_WORKER_PRIORITIES>;
+#elif defined(ZNL_WORKER_SHARDS)
+using WorkerQueue = ShardedMPSCIntrQueue<Task, ZNL_WORKER_SHARDS>;
+#else
+using WorkerQueue = TaskQueue;
+#endif
+#ifdef ZNL_WORKER_WAIT
+using WorkerWait = ZNL_WORKER_WAIT;
+#endif
+#ifndef ZNL_WORKER_RESERVE
+#define ZNL_WORKER_RESERVE 256
+#endif
+#ifndef ZNL_WORKER_SPIN_MAX_NS
+#define ZNL_WORKER_SPIN_MAX_NS 50000
+#endif
+#ifndef ZNL_WORKER_SPIN_MIN_NS
+#define ZNL_WORKER_SPIN_MIN_NS ( ZNL_WORKER_SPIN_MAX_NS < 1000 ? ZNL_WORKER_SPIN_MAX_NS : 1000 )
+#endif
+#ifndef ZNL_WORKER_TIMER_TICK_NS
+#define ZNL_WORKER_TIMER_TICK_NS 1000000
+#endif
+// Idle policy of _pop(), unless ZNL_WORKER_WAIT.
+using WorkerSpin = AdaptiveSpin<ZNL_WORKER_SPIN_MIN_NS, ZNL_WORKER_SPIN_MAX_NS>;
+
+class WorkerPool;
+
 class Worker
 {
 public:
-  Worker() :
+  Worker() : _timers( ZNL_WORKER_TIMER_TICK_NS ),
     _waiting( false ), _count( 0 ), _status( 0 ), _lock( ATOMIC_FLAG_INIT ) {}
-  Worker( const std::string& name_ ) : _name( name_ ),
+  Worker( const std::string& name_ ) : _name( name_ ), _timers( ZNL_WORKER_TIMER_TICK_NS ),
     _waiting( false ), _count( 0 ), _status( 0 ), _lock( ATOMIC_FLAG_INIT ) {}
+  Worker( const std::string& name_, const Placement& placement_, std::size_t index_ = 0 )
+    : Worker( name_ ) { set_placement( placement_, index_ ); }
   ~Worker();
   const std::string& name() const { return _name; }
   void set_name( const std::string& name_ ) { _name = name_; }
+  // Before start(): the thread pins itself to placement_.cpu( index_ ) and
+  // carves ZNL_WORKER_RESERVE Tasks from memory on that CPU's node.
+  void set_placement( const Placement& placement_, std::size_t index_ ) {
+    _cpu = placement_.cpu( index_ );
+    _node = placement_.node( index_ );
+  }
+  int cpu() const { return _cpu; }
+  // Idle periods that ended while spinning, and in a park.
+  std::uint64_t idle_spins() const { return _spin.spins(); }
+  std::uint64_t idle_parks() const { return _spin.parks(); }
+  // Lock-free from any thread, e.g. a monitor sampling it periodically.
+  WorkerStats stats() const {
+    WorkerStats stats;
+    _metrics.snapshot( stats );
+    stats.spins = _spin.spins();
+    stats.parks += _spin.parks();
+    return stats;
+  }
   void start();
   void start( std::function<int( std::thread& )>&& prepare_ );
   bool is_running() { return _thread.joinable(); }
-  void send_stop() { send( _stop ); }
+  void send_stop( unsigned priority_ = 0 ) { send( _stop, priority_ ); }
   void wait_until_stopped() { if( _thread.joinable() ) { _thread.join(); } }
   void stop() { send_stop(); wait_until_stopped(); }
-  void send( const Task& task_ );
+  // Higher priorities are popped first; ignored unless ZNL_WORKER_PRIORITIES.
+  void send( const Task& task_, unsigned priority_ = 0 );
+  // Moves func_ into a Task from the Worker's pool, returned after it runs.
+  void send( Func&& func_, unsigned priority_ = 0 ) {
+    Task* task = _taskpool.allocate( std::move( func_ ) );
+    task->set_pooled();
+    send( *task, priority_ );
+  }
+  // Links the Tasks (or Task pointers) in first_..last_ and publishes them
+  // with a single push, then wakes the Worker at most once.
+  template<typename InputIt>
+  void send_batch( InputIt first_, InputIt last_, unsigned priority_ = 0 );
+  class Batcher;
+  // send() of f_ with a Future for what it returns.
+  template<typename F>
+  Future<typename std::result_of<typename std::decay<F>::type&()>::type>
+  submit( F&& f_, unsigned priority_ = 0 );
+  // Runs func_ on the Worker thread once delay_ has passed, on the next
+  // ZNL_WORKER_TIMER_TICK_NS tick. The Worker parks no longer than until
+  // its next timer is due, rather than the task blocking it in a sleep.
+  template<typename Rep, typename Period>
+  Timer send_after( const std::chrono::duration<Rep, Period>& delay_, Func&& func_ ) {
+    return _send_timer( _ns( delay_ ), 0, std::move( func_ ) );
+  }
+  // Every period_, the first time after one period_. Runs that fall due
+  // while the Worker is still busy are skipped, not bunched up.
+  template<typename Rep, typename Period>
+  Timer send_every( const std::chrono::duration<Rep, Period>& period_, Func&& func_ ) {
+    const std::uint64_t period = _ns( period_ );
+    return _send_timer( period, period ? period : 1, std::move( func_ ) );
+  }
   void set_status( int status_ ) { _status = status_; }
   int get_status() const { return _status; }
+  // The WorkerPool this Worker belongs to, if any.
+  WorkerPool* pool() const { return _pool; }
 private:
+  friend class WorkerPool;
+  friend class Timer;
+  typedef MPSCIntrQueue<detail::TimerLink> TimerQueue;
+  void _push( const Task& task_, unsigned priority_ ) {
+#ifdef ZNL_WORKER_PRIORITIES
+    _taskqueue.push( task_, priority_ );
+#else
+    ( void ) priority_;
+    _taskqueue.push( task_ );
+#endif
+  }
+  static const Task& _task( const Task& task_ ) { return task_; }
+  static const Task& _task( const Task* task_ ) { return *task_; }
+#if !defined(ZNL_WORKER_BOUNDED) && !defined(ZNL_WORKER_SPSC)
+  void _push_chain( const Task& first_, const Task& last_, unsigned priority_ ) {
+#ifdef ZNL_WORKER_PRIORITIES
+    _taskqueue.push_chain( first_, last_, priority_ );
+#else
+    ( void ) priority_;
+    _taskqueue.push_chain( first_, last_ );
+#endif
+  }
+#endif
+  template<typename Rep, typename Period>
+  static std::uint64_t _ns( const std::chrono::duration<Rep, Period>& duration_ ) {
+    const std::chrono::nanoseconds ns = std::chrono::duration_cast<std::chrono::nanoseconds>( duration_ );
+    return ns.count() > 0 ? ns.count() : 0;
+  }
+  Timer _send_timer( std::uint64_t delay_ns_, std::uint64_t period_ns_, Func&& func_ );
+  // Arms and cancels what is in _timerqueue; returns the count.
+  std::size_t _take_timers();
+  void _run_timers();
+  // Until the next timer is due, -1 without timers.
+  std::int64_t _timeout() const {
+    return _timers.empty() ? -1 : _timers.timeout_ns( TimerWheel::now_ns() );
+  }
+  // &_tick when _take_timers() took any, else the next mailbox Task.
+  const Task* _poll();
+  // After pushing n_ Tasks.
+  void _wake( int n_ );
+  void _notify( int n_ = 1 );
   void _run();
   const Task& _pop();
 protected:
@@ -64,18 +219,141 @@ protected:
   }
 private:
   std::string             _name;
-  TaskQueue               _taskqueue;
+  TaskPool                _taskpool;
+  WorkerQueue             _taskqueue;
+  detail::TimerPool       _timerpool;
+  TimerQueue              _timerqueue;
+  TimerWheel              _timers; // Worker thread only
   std::atomic<bool>       _waiting;
   std::atomic<int>        _count;
   std::atomic<int>        _status;
   std::atomic_flag        _lock;
-#ifndef ZNL_MULTIUSE_FUTURE
+#ifdef ZNL_WORKER_WAIT
+  WorkerWait              _wait;
+#endif
+  WorkerSpin              _spin;
+  WorkerMetrics           _metrics;
+#if defined(ZNL_WORKER_CONDVAR)
   std::condition_variable _condvar;
   std::mutex              _mutex;
+#elif defined(ZNL_WORKER_EVENTCOUNT)
+  EventCount              _eventcount;
 #endif
   std::promise<void>      _ready;
   std::thread             _thread;
   Task                    _stop;
+  Task                    _tick; // from _pop() when timers may be due
+  WorkerPool*             _pool = nullptr;
+  std::size_t             _index = 0;
+  bool                    _stopping = false; // pool member saw _stop
+  int                     _cpu = -1;
+  int                     _node = -1;
+};
+
+template<typename InputIt>
+void Worker::send_batch( InputIt first_, InputIt last_, unsigned priority_ )
+{
+  int n = 0;
+  const std::uint64_t now = WorkerMetrics::now();
+#if defined(ZNL_WORKER_BOUNDED) || defined(ZNL_WORKER_SPSC)
+  // a ring has no chains: one push each, but still one wakeup
+  for( ; first_ != last_; ++first_, ++n ) {
+    WorkerMetrics::stamp( _task( *first_ ), now );
+    _metrics.sent();
+    _push( _task( *first_ ), priority_ );
+  }
+#else
+  if( first_ == last_ ) {
+    return;
+  }
+  const Task* first = &_task( *first_ );
+  const Task* last = first;
+  WorkerMetrics::stamp( *first, now );
+  for( ++first_, n = 1; first_ != last_; ++first_, ++n ) {
+    const Task* task = &_task( *first_ );
+    WorkerMetrics::stamp( *task, now );
+    WorkerQueue::link( *last, *task );
+    last = task;
+  }
+  _metrics.sent( n );
+  _push_chain( *first, *last, priority_ );
+#endif
+  if( n ) {
+    _wake( n );
+  }
+}
+
+template<typename F>
+Future<typename std::result_of<typename std::decay<F>::type&()>::type>
+Worker::submit( F&& f_, unsigned priority_ )
+{
+  typedef typename std::decay<F>::type Fn;
+  typedef typename std::result_of<Fn&()>::type R;
+  typedef detail::Submitted<Fn, R> State;
+  Task* task = _taskpool.allocate( Func( State( std::forward<F>( f_ ) ) ) );
+  State* state = const_cast<State*>( task->get_value().template target<State>() );
+  state->_node = task;
+  state->_pool = &_taskpool;
+  Future<R> future( state, this );
+  send( *task, priority_ );
+  return future;
+}
+
+template<typename R>
+template<typename G>
+void Future<R>::then( G&& g_ )
+{
+  detail::FutureState<R>* state = _state;
+  _state = nullptr;
+  state->_then = state->_pool->allocate(
+    Func( detail::Continuation<R, typename std::decay<G>::type>{ state, std::forward<G>( g_ ) } ) );
+  const std::uint32_t prev = state->_state.fetch_or( detail::FutureStateBase::continued |
+                                                     detail::FutureStateBase::detached,
+                                                     std::memory_order_acq_rel );
+  if( prev & detail::FutureStateBase::ready ) {
+    _worker->send( [state] () {
+                     state->run_then();
+                     state->_pool->deallocate_shared( state->_node );
+                   } );
+  }
+}
+
+// Collects sends to one Worker on the sending thread and passes them to
+// send_batch() when limit_ are pending, on flush() and on destruction.
+class Worker::Batcher
+{
+public:
+  static constexpr std::size_t capacity = 64;
+
+  explicit Batcher( Worker& worker_, std::size_t limit_ = capacity, unsigned priority_ = 0 )
+    : _worker( worker_ ), _limit( limit_ && limit_ < capacity ? limit_ : capacity ),
+      _priority( priority_ ), _size( 0 ) {}
+  Batcher( const Batcher& ) = delete;
+  Batcher& operator=( const Batcher& ) = delete;
+  ~Batcher() { flush(); }
+  void send( const Task& task_ ) {
+    _tasks[_size++] = &task_;
+    if( _size == _limit ) {
+      flush();
+    }
+  }
+  void send( Func&& func_ ) {
+    Task* task = _worker._taskpool.allocate( std::move( func_ ) );
+    task->set_pooled();
+    send( *task );
+  }
+  void flush() {
+    _worker.send_batch( _tasks, _tasks + _size, _priority );
+    _size = 0;
+  }
+  std::size_t size() const { return _size; }
+
+private:
+  Worker&           _worker;
+  const std::size_t _limit;
+  const unsigned    _priority;
+  std::size_t       _size;
+  const Task*       _tasks[capacity];
 };
 
 } //namespace znl
@@ -0,0 +1,231 @@
+//  Worker runtime metrics
+//
+//  Copyright (C) 2018 Zoltan N. Leskowsky
+//
+//  Distributed under the Boost Software License, Version 1.0. (See
+//  accompanying file LICENSE_1_0.txt or copy at
+//  http://www.boost.org/LICENSE_1_0.txt)
+
+#ifndef ZNL_WORKER_METRICS_HPP_INCLUDED
+#define ZNL_WORKER_METRICS_HPP_INCLUDED
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+
+#include "taskqueue.hpp"
+
+#ifdef BOOST_HAS_PRAGMA_ONCE
+#pragma once
+#endif
+
+
+#if defined(_MSC_VER)
+#endif
+
+
+//#define ZNL_WORKER_METRICS // per-Worker counters and histograms, see Worker::stats()
+
+namespace znl {
+
+// Counts of durations by powers of two: bucket 0 holds 0 ns, bucket i
+// [2^(i-1), 2^i) ns, and the last bucket everything from 2^(buckets-2) ns,
+// about 4.6 minutes, on.
+
+struct Histogram
+{
+  static constexpr std::size_t buckets = 40;
+
+  static std::size_t bucket( std::uint64_t ns_ ) {
+    if( !ns_ ) {
+      return 0;
+    }
+#if defined(__GNUC__)
+    const std::size_t width = 64 - __builtin_clzll( ns_ );
+#else
+    std::size_t width = 0;
+    for( ; ns_; ns_ >>= 1 ) {
+      ++width;
+    }
+#endif
+    return width < buckets ? width : buckets - 1;
+  }
+  // Exclusive; the last bucket has none.
+  static std::uint64_t upper_ns( std::size_t bucket_ ) {
+    return bucket_ + 1 < buckets ? std::uint64_t( 1 ) << bucket_ : UINT64_MAX;
+  }
+  std::uint64_t count() const {
+    std::uint64_t n = 0;
+    for( std::size_t i = 0; i < buckets; ++i ) {
+      n += counts[i];
+    }
+    return n;
+  }
+  // The upper bound of the bucket holding the q_ quantile, 0 < q_ <= 1; 0
+  // when empty.
+  std::uint64_t quantile_ns( double q_ ) const {
+    const std::uint64_t n = count();
+    std::uint64_t rank = static_cast<std::uint64_t>( q_ * n + 0.5 ), seen = 0;
+    rank = rank ? rank : 1;
+    for( std::size_t i = 0; i < buckets && n; ++i ) {
+      if( ( seen += counts[i] ) >= rank ) {
+        return upper_ns( i );
+      }
+    }
+    return 0;
+  }
+  Histogram& operator+=( const Histogram& histogram_ ) {
+    for( std::size_t i = 0; i < buckets; ++i ) {
+      counts[i] += histogram_.counts[i];
+    }
+    return *this;
+  }
+
+  std::uint64_t counts[buckets];
+};
+
+// A snapshot of Worker::stats(). Without ZNL_WORKER_METRICS only spins and
+// parks are counted.
+
+struct WorkerStats
+{
+  WorkerStats& operator+=( const WorkerStats& stats_ ) {
+    tasks += stats_.tasks;
+    max_depth = max_depth < stats_.max_depth ? stats_.max_depth : max_depth;
+    busy_ns += stats_.busy_ns;
+    idle_ns += stats_.idle_ns;
+    spins += stats_.spins;
+    parks += stats_.parks;
+    wakes += stats_.wakes;
+    queue_wait += stats_.queue_wait;
+    run_time += stats_.run_time;
+    return *this;
+  }
+
+  std::uint64_t tasks;      // run to completion
+  std::uint64_t max_depth;  // mailbox high-water mark, seen at each pop
+  std::uint64_t busy_ns;    // running tasks
+  std::uint64_t idle_ns;    // from each task to the start of the next
+  std::uint64_t spins;      // idle periods that ended while spinning
+  std::uint64_t parks;      // and in a park
+  std::uint64_t wakes;      // parks ended by a wakeup rather than a timer
+  Histogram     queue_wait; // from send, or WorkerPool::spawn(), to start
+  Histogram     run_time;
+};
+
+#ifdef ZNL_WORKER_METRICS
+
+// Written by the Worker thread, apart from the counters senders bump, and
+// read by any thread with relaxed loads: each field of a snapshot is exact,
+// but fields may be a task apart from one another. A task costs the Worker
+// two steady_clock reads and a sender one.
+
+class WorkerMetrics
+{
+public:
+  WorkerMetrics()
+    : _sent( 0 ), _taken( 0 ), _tasks( 0 ), _max_depth( 0 ), _busy_ns( 0 ),
+      _idle_ns( 0 ), _parks( 0 ), _wakes( 0 ), _start( 0 ), _last( 0 ) {
+    for( std::size_t i = 0; i < Histogram::buckets; ++i ) {
+      _queue_wait[i].store( 0, std::memory_order_relaxed );
+      _run_time[i].store( 0, std::memory_order_relaxed );
+    }
+  }
+  WorkerMetrics( const WorkerMetrics& ) = delete;
+  WorkerMetrics& operator=( const WorkerMetrics& ) = delete;
+
+  static std::uint64_t now() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+             std::chrono::steady_clock::now().time_since_epoch() ).count();
+  }
+
+  // Senders: stamp() each Task, then sent() before pushing.
+  static void stamp( const Task& task_, std::uint64_t now_ ) { task_.set_sent_ns( now_ ); }
+  void sent( std::size_t n_ = 1 ) { _sent.fetch_add( n_, std::memory_order_relaxed ); }
+
+  // The Worker thread.
+  void begin() { _last = now(); }
+  void taken() {
+    // a send is counted before its push, which the pop synchronizes with
+    const std::uint64_t depth = _sent.load( std::memory_order_relaxed ) - _taken++;
+    if( depth > _max_depth.load( std::memory_order_relaxed ) ) {
+      _max_depth.store( depth, std::memory_order_relaxed );
+    }
+  }
+  void started( const Task& task_ ) {
+    _start = now();
+    add( _idle_ns, _start - _last );
+    const std::uint64_t sent = task_.sent_ns();
+    if( sent ) {
+      add( _queue_wait[Histogram::bucket( _start > sent ? _start - sent : 0 )], 1 );
+    }
+  }
+  void finished() {
+    _last = now();
+    add( _busy_ns, _last - _start );
+    add( _run_time[Histogram::bucket( _last - _start )], 1 );
+    add( _tasks, 1 );
+  }
+  void parked() { add( _parks, 1 ); }
+  // Back from a park that was not a timeout.
+  void woken() { add( _wakes, 1 ); }
+
+  // Any thread.
+  void snapshot( WorkerStats& stats_ ) const {
+    stats_.tasks = _tasks.load( std::memory_order_relaxed );
+    stats_.max_depth = _max_depth.load( std::memory_order_relaxed );
+    stats_.busy_ns = _busy_ns.load( std::memory_order_relaxed );
+    stats_.idle_ns = _idle_ns.load( std::memory_order_relaxed );
+    stats_.spins = 0;
+    stats_.parks = _parks.load( std::memory_order_relaxed );
+    stats_.wakes = _wakes.load( std::memory_order_relaxed );
+    for( std::size_t i = 0; i < Histogram::buckets; ++i ) {
+      stats_.queue_wait.counts[i] = _queue_wait[i].load( std::memory_order_relaxed );
+      stats_.run_time.counts[i] = _run_time[i].load( std::memory_order_relaxed );
+    }
+  }
+
+private:
+  typedef std::atomic<std::uint64_t> Counter;
+  static void add( Counter& counter_, std::uint64_t n_ ) {
+    counter_.store( counter_.load( std::memory_order_relaxed ) + n_, std::memory_order_relaxed );
+  }
+
+private:
+  alignas( ZNL_CACHELINE_SIZE ) Counter _sent; // senders
+  alignas( ZNL_CACHELINE_SIZE ) std::uint64_t _taken; // Worker thread only
+  Counter                               _tasks;
+  Counter                               _max_depth;
+  Counter                               _busy_ns;
+  Counter                               _idle_ns;
+  Counter                               _parks;
+  Counter                               _wakes;
+  std::uint64_t                         _start;
+  std::uint64_t                         _last;
+  Counter                               _queue_wait[Histogram::buckets];
+  Counter                               _run_time[Histogram::buckets];
+};
+
+#else
+
+class WorkerMetrics
+{
+public:
+  static std::uint64_t now() { return 0; }
+  static void stamp( const Task&, std::uint64_t ) {}
+  void sent( std::size_t = 1 ) {}
+  void begin() {}
+  void taken() {}
+  void started( const Task& ) {}
+  void finished() {}
+  void parked() {}
+  void woken() {}
+  void snapshot( WorkerStats& stats_ ) const { stats_ = WorkerStats(); }
+};
+
+#endif //ZNL_WORKER_METRICS
+
+} //namespace znl
+
+#endif //ZNL_WORKER_METRICS_HPP_INCLUDED
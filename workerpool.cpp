@@ -0,0 +1,225 @@
+//  Work-stealing pool of Workers
+//
+//  Copyright (C) 2018 Zoltan N. Leskowsky
+//
+//  Distributed under the Boost Software License, Version 1.0. (See
+//  accompanying file LICENSE_1_0.txt or copy at
+//  http://www.boost.org/LICENSE_1_0.txt)
+
+#include <algorithm>
+#include <cstdint>
+#include <sstream>
+
+#include "workerpool.hpp"
+
+#ifndef ZNL_WORKER_SPSC
+
+namespace znl {
+
+constexpr std::size_t WorkerPool::drain_batch;
+
+static std::size_t random_index( std::size_t n_ )
+{
+  static std::atomic<std::uint32_t> seed( 0x9e3779b9 );
+  static thread_local std::uint32_t x = seed.fetch_add( 0x6d2b79f5 ) | 1;
+  x ^= x << 13; // xorshift32
+  x ^= x >> 17;
+  x ^= x << 5;
+  return x % n_;
+}
+
+WorkerPool::WorkerPool( std::size_t size_, const std::string& name_ )
+  : WorkerPool( size_, Placement(), name_ ) {}
+
+WorkerPool::WorkerPool( std::size_t size_, const Placement& placement_, const std::string& name_ )
+  : _size( size_ ? size_ : placement_.size() ? placement_.size() :
+           std::max( 1u, std::thread::hardware_concurrency() ) ),
+    _workers( _size ), _deques( _size ), _idle( _size ), _next( 0 ), _sleepers( 0 )
+{
+  for( std::size_t i = 0; i < _size; ++i ) {
+    std::stringstream ss;
+    ss << name_ << i;
+    _workers[i].set_name( ss.str() );
+    _workers[i].set_placement( placement_, i );
+    _workers[i]._pool = this;
+    _workers[i]._index = i;
+  }
+}
+
+void WorkerPool::start()
+{
+  for( std::size_t i = 0; i < _size; ++i ) {
+    _workers[i]._stopping = false;
+    _workers[i].start();
+  }
+}
+
+void WorkerPool::start( const std::function<int( std::thread& )>& prepare_ )
+{
+  for( std::size_t i = 0; i < _size; ++i ) {
+    _workers[i]._stopping = false;
+    _workers[i].start( std::function<int( std::thread& )>( prepare_ ) );
+  }
+}
+
+void WorkerPool::stop()
+{
+  for( std::size_t i = 0; i < _size; ++i ) {
+    if( _workers[i].is_running() ) {
+      _workers[i].send_stop();
+    }
+  }
+  for( std::size_t i = 0; i < _size; ++i ) {
+    _workers[i].wait_until_stopped();
+  }
+}
+
+WorkerStats WorkerPool::stats() const
+{
+  WorkerStats stats = _workers[0].stats();
+  for( std::size_t i = 1; i < _size; ++i ) {
+    stats += _workers[i].stats();
+  }
+  return stats;
+}
+
+void WorkerPool::spawn( const Task& task_ )
+{
+  Worker* self = current();
+  if( !self || self->_pool != this ) {
+    send( task_ );
+    return;
+  }
+  WorkerMetrics::stamp( task_, WorkerMetrics::now() );
+  _deques[self->_index].push( &task_ );
+  wake_idle( 1, self->_index );
+}
+
+void WorkerPool::spawn( Func&& func_ )
+{
+  Worker* self = current();
+  if( !self || self->_pool != this ) {
+    send( std::move( func_ ) );
+    return;
+  }
+  Task* task = self->_taskpool.allocate( std::move( func_ ) );
+  task->set_pooled();
+  WorkerMetrics::stamp( *task, WorkerMetrics::now() );
+  _deques[self->_index].push( task );
+  wake_idle( 1, self->_index );
+}
+
+const Task& WorkerPool::pop( Worker& self_, Worker*& owner_ )
+{
+  Deque& deque = _deques[self_._index];
+  const Task* ptask;
+  for( ;; ) {
+    if( self_._take_timers() ) {
+      return self_._tick;
+    }
+    if( deque.pop( ptask ) || ( drain( self_ ) && deque.pop( ptask ) ) ) {
+      return *ptask;
+    }
+    if( self_._stopping ) {
+      return self_._stop;
+    }
+    if( steal( self_._index, ptask, owner_ ) ) {
+      return *ptask;
+    }
+    EventCount& idle = _idle[self_._index].parked;
+    _sleepers.fetch_add( 1, std::memory_order_relaxed ); // before prepare_wait()'s fence
+    const EventCount::Key key = idle.prepare_wait();
+    if( drain( self_ ) || self_._stopping || any_stealable() ) {
+      idle.cancel_wait();
+      _sleepers.fetch_sub( 1, std::memory_order_relaxed );
+      continue;
+    }
+    if( self_._take_timers() ) {
+      idle.cancel_wait();
+      _sleepers.fetch_sub( 1, std::memory_order_relaxed );
+      return self_._tick;
+    }
+    self_._metrics.parked();
+    const std::int64_t timeout = self_._timeout();
+    bool notified = true;
+    if( timeout < 0 ) {
+      idle.commit_wait( key );
+    } else {
+      notified = idle.commit_wait_for( key, std::chrono::nanoseconds( timeout ) );
+    }
+    _sleepers.fetch_sub( 1, std::memory_order_relaxed );
+    if( !notified ) {
+      return self_._tick; // a timer is due
+    }
+    self_._metrics.woken();
+  }
+}
+
+// Wakes up to n_ parked Workers other than self_, starting at a random one,
+// once stealable work is on a deque. One fence covers all the Workers'
+// EventCounts, and _sleepers spares the scan while none is parked.
+void WorkerPool::wake_idle( std::size_t n_, std::size_t self_ )
+{
+  std::atomic_thread_fence( std::memory_order_seq_cst );
+  if( !_sleepers.load( std::memory_order_relaxed ) ) {
+    return;
+  }
+  std::size_t i = random_index( _size );
+  for( std::size_t k = 0; k < _size && n_; ++k, i = i + 1 == _size ? 0 : i + 1 ) {
+    if( i != self_ && _idle[i].parked.has_waiters() && _idle[i].parked.notify() ) {
+      --n_;
+    }
+  }
+}
+
+// Moves up to drain_batch Tasks from the mailbox onto the deque, where they
+// may be stolen, and wakes a thief for each but the one self_ pops next.
+bool WorkerPool::drain( Worker& self_ )
+{
+  Deque& deque = _deques[self_._index];
+  std::size_t n = 0;
+  const Task* ptask;
+  while( n < drain_batch && ( ptask = self_._taskqueue.waiting_pop() ) != nullptr ) {
+    if( ptask->is_pooled() && !*ptask ) { // run by a thief, sent back
+      self_._taskpool.deallocate( const_cast<Task*>( ptask ) );
+      continue;
+    }
+    self_._metrics.taken();
+    if( ptask == &self_._stop ) {
+      self_._stopping = true;
+      break;
+    }
+    deque.push( ptask );
+    ++n;
+  }
+  if( n > 1 ) {
+    wake_idle( n - 1, self_._index );
+  }
+  return n != 0;
+}
+
+bool WorkerPool::steal( std::size_t self_, const Task*& ptask_, Worker*& owner_ )
+{
+  std::size_t victim = random_index( _size );
+  for( std::size_t i = 0; i < _size; ++i, victim = victim + 1 == _size ? 0 : victim + 1 ) {
+    if( victim != self_ && _deques[victim].steal( ptask_ ) ) {
+      owner_ = &_workers[victim];
+      return true;
+    }
+  }
+  return false;
+}
+
+bool WorkerPool::any_stealable() const
+{
+  for( std::size_t i = 0; i < _size; ++i ) {
+    if( !_deques[i].is_empty() ) {
+      return true;
+    }
+  }
+  return false;
+}
+
+} //namespace znl
+
+#endif //ZNL_WORKER_SPSC
@@ -0,0 +1,162 @@
+//  Work-stealing pool of Workers
+//
+//  Copyright (C) 2018 Zoltan N. Leskowsky
+//
+//  Distributed under the Boost Software License, Version 1.0. (See
+//  accompanying file LICENSE_1_0.txt or copy at
+//  http://www.boost.org/LICENSE_1_0.txt)
+
+#ifndef ZNL_WORKER_POOL_HPP_INCLUDED
+#define ZNL_WORKER_POOL_HPP_INCLUDED
+
+#include <atomic>
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <new>
+#include <string>
+#include <thread>
+
+#include "chaselevdeque.hpp"
+#include "eventcount.hpp"
+#include "worker.hpp"
+
+#ifdef BOOST_HAS_PRAGMA_ONCE
+#pragma once
+#endif
+
+
+#if defined(_MSC_VER)
+#endif
+
+// Not with ZNL_WORKER_SPSC: stolen Tasks go back to their owner's mailbox,
+// which needs several senders.
+#ifndef ZNL_WORKER_SPSC
+
+namespace znl {
+
+namespace detail {
+
+// new T[size_] for over-aligned T: operator new is not alignment-aware
+// before C++17.
+template<typename T>
+class AlignedArray
+{
+public:
+  explicit AlignedArray( std::size_t size_ )
+    : _raw( ::operator new( size_ * sizeof( T ) + alignof( T ) - 1 ) ), _size( size_ ) {
+    std::size_t space = size_ * sizeof( T ) + alignof( T ) - 1;
+    void* aligned = _raw;
+    _data = static_cast<T*>( std::align( alignof( T ), size_ * sizeof( T ), aligned, space ) );
+    for( std::size_t i = 0; i < _size; ++i ) {
+      new ( &_data[i] ) T();
+    }
+  }
+  AlignedArray( const AlignedArray& ) = delete;
+  AlignedArray& operator=( const AlignedArray& ) = delete;
+  ~AlignedArray() {
+    for( std::size_t i = _size; i-- > 0; ) {
+      _data[i].~T();
+    }
+    ::operator delete( _raw );
+  }
+  T& operator[]( std::size_t i_ ) { return _data[i_]; }
+  const T& operator[]( std::size_t i_ ) const { return _data[i_]; }
+
+private:
+  void*             _raw;
+  const std::size_t _size;
+  T*                _data;
+};
+
+} //namespace detail
+
+// Workers that share their load. Each Worker keeps a Chase-Lev deque: it
+// moves what arrives in its mailbox onto the deque in batches and runs from
+// the bottom, while idle Workers steal from the top of a random victim's
+// deque.
+//
+// Only what is on a deque can be stolen. A Worker drains its mailbox only
+// once its deque runs empty, so Tasks sent to a Worker busy with a long
+// task wait for that task to end, even while other Workers are idle; this
+// includes the share of WorkerPool::send() that reaches that Worker
+// round-robin. Work that must spread while a Worker is busy should be
+// spawned from within the pool, or sent ahead of the long task.
+//
+// Worker::send() and start( prepare_ ) work as for a lone Worker, and send()
+// to one Worker spreads to the others. spawn() from a task running in the
+// pool pushes straight onto the running Worker's deque. Each idle Worker
+// sleeps on an EventCount of its own: send() wakes only the receiver, as
+// only it can read its mailbox, while spawn() and a Worker that drains more
+// than it can run wake other idle Workers to steal.
+//
+// A pooled Task (send( Func&& ), spawn( Func&& )) that is stolen is sent
+// back to its owner once run, so that only the owner deallocates it.
+// Timers from a member's send_after() and send_every() run on that member,
+// which parks no longer than until the next one is due.
+
+class WorkerPool
+{
+  typedef ChaseLevDeque<const Task*> Deque;
+public:
+  // size_ 0 is one Worker per hardware thread, or per placement_ slot.
+  explicit WorkerPool( std::size_t size_ = 0, const std::string& name_ = "Pool" );
+  WorkerPool( std::size_t size_, const Placement& placement_, const std::string& name_ = "Pool" );
+  WorkerPool( const WorkerPool& ) = delete;
+  WorkerPool& operator=( const WorkerPool& ) = delete;
+  ~WorkerPool() { stop(); }
+  std::size_t size() const { return _size; }
+  Worker& worker( std::size_t i_ ) { return _workers[i_]; }
+  // The sum of the Workers' stats(); max_depth is the largest.
+  WorkerStats stats() const;
+  void start();
+  void start( const std::function<int( std::thread& )>& prepare_ );
+  // Stops each Worker once its deque is empty; waits for all.
+  void stop();
+  // To the next Worker's mailbox, round-robin; not stealable while it is busy.
+  void send( const Task& task_ ) { next().send( task_ ); }
+  void send( Func&& func_ ) { next().send( std::move( func_ ) ); }
+  // Onto the calling Worker's deque when called from this pool, else send().
+  void spawn( const Task& task_ );
+  void spawn( Func&& func_ );
+  // The Worker running the calling thread, if it is a pool member.
+  static Worker* current() { return current_ref(); }
+
+private:
+  friend class Worker;
+  static constexpr std::size_t drain_batch = 64;
+
+  struct alignas( ZNL_CACHELINE_SIZE ) Idle
+  {
+    EventCount parked;
+  };
+
+  static Worker*& current_ref() {
+    static thread_local Worker* worker = nullptr;
+    return worker;
+  }
+  static void set_current( Worker* worker_ ) { current_ref() = worker_; }
+  Worker& next() {
+    return _workers[_next.fetch_add( 1, std::memory_order_relaxed ) % _size];
+  }
+  void wake( std::size_t i_ ) { _idle[i_].parked.notify(); }
+  void wake_idle( std::size_t n_, std::size_t self_ );
+  const Task& pop( Worker& self_, Worker*& owner_ );
+  bool drain( Worker& self_ );
+  bool steal( std::size_t self_, const Task*& ptask_, Worker*& owner_ );
+  bool any_stealable() const;
+
+private:
+  const std::size_t            _size;
+  detail::AlignedArray<Worker> _workers;
+  detail::AlignedArray<Deque>  _deques;
+  detail::AlignedArray<Idle>   _idle;
+  std::atomic<std::size_t>     _next;
+  std::atomic<std::size_t>     _sleepers; // Workers between prepare_wait() and waking
+};
+
+} //namespace znl
+
+#endif //ZNL_WORKER_SPSC
+
+#endif //ZNL_WORKER_POOL_HPP_INCLUDED